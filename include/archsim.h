@@ -13,7 +13,7 @@
 #define _ARCHSIM_H_
 
 #define BUF_LEN 100
-#define MAX_NUM_INSTR 10000
+#define DEFAULT_MAX_CYCLES 10000 // Cycle limit of the pipeline unless -c is given.
 
 /* #include statements
  * The following #include lines will allow archsim.h to access the functions and
@@ -70,8 +70,39 @@ extern FILE *errfile;
 // Used to pass in the name of the input ELF file, through handle_args
 extern char *infile_name;
 
-// Used to enable verbose debug logging, as a parameter to show_instr
+// Level of the pipeline trace printed each cycle, 0 for none
 extern int debug_level;
+
+/* Fast-forward controls, set through handle_args. The functional model runs
+ * until ff_instr instructions have retired or the PC reaches ff_PC, and the
+ * pipeline takes over from there. If functional_only is set, the functional
+ * model runs the whole program. A value of 0 disables that condition.
+ */
+extern uint64_t ff_instr;
+extern uint64_t ff_PC;
+extern bool functional_only;
+
+/* Run limits, set through handle_args. The run stops after max_cycles
+ * pipeline cycles or max_retired retired instructions, or once the
+ * instruction at stop_PC retires. A value of 0 disables that limit.
+ * stop_symbol names the stop address until main resolves it.
+ */
+extern uint64_t max_cycles;
+extern uint64_t max_retired;
+extern uint64_t stop_PC;
+extern char *stop_symbol;
+
+// The functional model runs translated host code unless this is cleared.
+extern bool use_jit;
+
+/* Sampling controls, set through handle_args. Every sample_period retired
+ * instructions, the pipeline runs sample_warm instructions to warm up and
+ * then measures CPI over sample_unit instructions. A sample_period of 0
+ * disables sampling.
+ */
+extern uint64_t sample_period;
+extern uint64_t sample_warm;
+extern uint64_t sample_unit;
 /* This is a string containing the prompt that will be displayed by the ci. */
 extern char *ae_prompt;
 
@@ -0,0 +1,47 @@
+#ifndef _BPRED_H_
+#define _BPRED_H_
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "instr.h"
+
+// Direction predictors for B.cond.
+typedef enum bpred_kind {
+    BP_TAKEN,   // Always taken.
+    BP_BIMODAL, // 2-bit counters indexed by PC.
+    BP_GSHARE,  // 2-bit counters indexed by PC xor global history.
+    BP_TAGE,    // Bimodal base plus tagged tables on longer histories.
+    BP_NONE = -1
+} bpred_kind_t;
+
+#define BPRED_DEFAULT_BITS 12 // log2 of the counters in a table.
+#define BPRED_MAX_BITS 24
+#define TAGE_TABLES 4
+#define TAGE_TAG_BITS 8
+#define RAS_DEFAULT_DEPTH 16
+#define RAS_MAX_DEPTH 1024
+
+/* Configuration, set by bpred_configure() from the -P option. A
+ * btb_bits of 0 means there is no BTB, and every branch target is known
+ * at fetch from predecode. A ras_depth of 0 means there is no return
+ * address stack, and every RET waits for its target from D.
+ */
+extern bpred_kind_t bpred_kind;
+extern unsigned bpred_bits;
+extern unsigned btb_bits;
+extern unsigned ras_depth;
+// Print predictor statistics at exit.
+extern bool bpred_report;
+
+extern bool bpred_configure(const char *spec);
+extern void bpred_init(void);
+extern uint64_t bpred_history(void);
+extern bool bpred_direction(const uint64_t PC, const uint64_t hist);
+extern bool btb_lookup(const uint64_t PC);
+extern void ras_committed(uint16_t *tos, uint16_t *count);
+extern void ras_push(uint16_t *tos, uint16_t *count, const uint64_t ret_PC);
+extern bool ras_pop(uint16_t *tos, uint16_t *count, uint64_t *target);
+extern void ras_recover(void);
+extern void bpred_resolve(const instr_impl_t *insn, const bool taken);
+extern void bpred_print_stats(FILE *);
+#endif
@@ -1,3 +1,5 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
 #include <stdio.h>
 #include <stdbool.h>
 
@@ -11,24 +13,76 @@ typedef unsigned char byte_t;
 typedef long long int word_t;
 typedef long long unsigned uword_t;
 
+/* A line holds everything but its tag and valid bit, which live in the
+ * set's tag store so that a lookup only touches the tags, and its
+ * replacement state, which is kept per set by the policy.
+ */
 typedef struct cache_line {
-    bool valid;
-    uword_t tag;
     bool dirty;
-    uword_t lru;
     byte_t *data;
 } cache_line_t;
 
+/* Tags of a set are padded to a multiple of TAG_CHUNK ways and aligned
+ * to TAG_ALIGN bytes, so each chunk is compared in one vector operation.
+ * Bit w of valid[w / 64] is set while way w holds a line.
+ */
+#define TAG_CHUNK 4
+#define TAG_ALIGN 32
+
+/* Replacement policies. The metadata each keeps per set is
+ *   LRU    a last-use stamp per way
+ *   PLRU   E-1 tree bits, packed
+ *   SRRIP  a 2-bit re-reference prediction per way, packed; fills are
+ *          predicted long, hits near
+ *   BRRIP  as SRRIP, but most fills are predicted distant
+ *   FIFO   the way filled next
+ *   RANDOM nothing; victims come from a generator with a fixed seed
+ */
+typedef enum repl_policy {
+    REPL_LRU,
+    REPL_PLRU,
+    REPL_SRRIP,
+    REPL_BRRIP,
+    REPL_FIFO,
+    REPL_RANDOM
+} repl_policy_t;
+
+#define RRPV_BITS 2
+#define RRPV_MAX ((1 << RRPV_BITS) - 1)
+#define BRRIP_LONG_ONE_IN 32 /* BRRIP predicts this fraction of fills long */
+#define REPL_SEED 0x9e3779b97f4a7c15ULL
+
 typedef struct cache_set {
+    uword_t *tags;
+    uword_t *valid;
+    uword_t *repl; /* replacement metadata */
     cache_line_t *lines;
 } cache_set_t;
 
+typedef struct {
+    bool valid;
+    bool dirty;
+    uword_t addr;
+    byte_t *data;
+} evicted_line_t;
+
 typedef struct cache {
     cache_set_t *sets;
+    uword_t *tag_store;   /* tags of every set, contiguous */
+    uword_t *valid_store; /* valid bits of every set, contiguous */
+    uword_t *repl_store;  /* replacement metadata of every set, contiguous */
+    repl_policy_t policy;
+    uword_t repl_clock;   /* LRU stamp of the next use */
+    uword_t repl_rng;     /* state of the RANDOM and BRRIP generator */
     unsigned int s; /* set index bits */
     unsigned int b; /* block offset bits */
     unsigned int E; /* associativity */
     unsigned int d; /* cache delay */
+    /* The victim of the last miss, valid until the next one. Its data is
+     * the victim line's own block: the line takes the block left here by
+     * the previous miss instead, so a miss neither copies nor allocates.
+     */
+    evicted_line_t evicted;
 } cache_t;
 
 
@@ -37,13 +91,6 @@ typedef enum {
     WRITE
 } operation_t;
 
-typedef struct {
-    bool valid;
-    bool dirty;
-    uword_t addr;
-    byte_t *data;
-} evicted_line_t;
-
 
 cache_t *create_cache(int s_in, int b_in, int E_in, int d_in);
 void free_cache(cache_t *cache);
@@ -51,9 +98,23 @@ void access_data(cache_t *cache, uword_t addr, operation_t operation);
 
 evicted_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data);
 bool check_hit(cache_t *cache, uword_t addr, operation_t operation);
+cache_line_t *get_line(cache_t *cache, uword_t addr);
+void invalidate_line(cache_t *cache, uword_t addr);
 
 void get_word_cache(cache_t *cache, uword_t addr, word_t *dest);
 void set_word_cache(cache_t *cache, uword_t addr, word_t val);
 
 cache_t *create_checkpoint(cache_t *cache);
-void display_set(cache_t *cache, unsigned int set_index);
\ No newline at end of file
+void display_set(cache_t *cache, unsigned int set_index);
+
+/* The policy of caches made by create_cache() from then on */
+extern repl_policy_t repl_policy;
+
+bool repl_parse(const char *name, repl_policy_t *policy);
+const char *repl_name(repl_policy_t policy);
+unsigned int repl_words(repl_policy_t policy, unsigned int E);
+void repl_touch(cache_t *cache, cache_set_t *set, unsigned int way);
+void repl_fill(cache_t *cache, cache_set_t *set, unsigned int way);
+unsigned int repl_victim(cache_t *cache, cache_set_t *set);
+uword_t repl_state(const cache_t *cache, const cache_set_t *set, unsigned int way);
+#endif
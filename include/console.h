@@ -0,0 +1,16 @@
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CONSOLE_BUFSIZE (1 << 16)
+
+// Echo 8-byte guest output to errfile as LOG_OUTPUT messages.
+extern bool console_echo;
+
+extern void console_init(void);
+extern void console_write(const uint64_t data, const unsigned width);
+extern void console_flush(void);
+extern bool console_input(const char *fileName);
+extern uint64_t console_read(const unsigned width);
+#endif
@@ -1,6 +1,8 @@
 #ifndef _ELF_LOADER_H_
 #define _ELF_LOADER_H_
 #include <stdint.h>
+#include <stdbool.h>
 
 extern uint64_t loadElf(const char *file);
+extern bool lookupSymbol(const char *name, uint64_t *addr);
 #endif
\ No newline at end of file
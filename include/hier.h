@@ -0,0 +1,60 @@
+#ifndef _HIER_H_
+#define _HIER_H_
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cache/cache.h"
+#include "perf.h"
+
+/* The cache hierarchy: the L1D, which is guest.cache, an optional L1I
+ * given with -C, and up to two lower levels, L2 and L3, given with -L,
+ * which both L1s share. Every level has the block size
+ * set by -b and the replacement policy set by -R. A miss in a level is
+ * passed to the level below, and -d is the latency of memory.
+ *
+ * The inclusion policy of a lower level says how it relates to the levels
+ * above it:
+ *   inclusive  every block above is also here; an eviction here
+ *              invalidates the block above (back-invalidation)
+ *   nine       fills go here as well as above, and evictions here leave
+ *              the levels above alone
+ *   exclusive  blocks are here or above, never both; fills from below
+ *              bypass this level, a hit moves the block up, and blocks
+ *              evicted above are kept here
+ */
+
+#define HIER_MAX_LEVELS 3 // L1D, L2, L3.
+#define HIER_MAX_BITS 30  // Of s + b, so that a level's size fits an int.
+
+// The L1 an access starts in.
+typedef enum hier_top {
+    HIER_L1D,
+    HIER_L1I
+} hier_top_t;
+
+typedef enum incl_policy {
+    INCL_INCLUSIVE,
+    INCL_NINE,
+    INCL_EXCLUSIVE
+} incl_policy_t;
+
+typedef struct cache_level {
+    const char *name;
+    cache_t *cache;
+    unsigned s, E, d;     // d is the latency of a hit here, seen from above.
+    incl_policy_t incl;   // Not used for the L1D.
+    uint64_t accesses;    // Of an L1, blocks touched by loads and stores or fetches; below, fills asked for from above.
+    uint64_t misses;
+    uint64_t writebacks;  // Dirty blocks written to the level below.
+    uint64_t back_invals; // Blocks invalidated above by evictions here.
+} cache_level_t;
+
+extern bool hier_configure(const char *spec);
+extern bool hier_configure_l1i(const char *spec);
+extern cache_t *hier_init(const unsigned s, const unsigned b, const unsigned E, const unsigned d);
+extern cache_t *hier_l1i(void);
+extern uint64_t hier_latency(const hier_top_t top, const uint64_t addr, perf_cause_t *cause);
+extern void hier_fill(const hier_top_t top, const uint64_t addr, const operation_t op);
+extern void hier_count_access(const hier_top_t top, const uint64_t addr, const unsigned width);
+extern void hier_print_stats(FILE *);
+#endif
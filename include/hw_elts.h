@@ -15,4 +15,8 @@ extern comb_logic_t alu(uint64_t alu_vala, uint64_t alu_valb, uint8_t alu_valhw,
 extern comb_logic_t dmem(uint64_t dmem_addr, uint64_t dmem_wval,                                // in, data
                          bool dmem_read, bool dmem_write,                                       // in, control
                          uint64_t *dmem_rval, bool *dmem_err);                                   // out
+// dmem(), waiting out any cache miss.
+extern comb_logic_t dmem_complete(uint64_t dmem_addr, uint64_t dmem_wval,                       // in, data
+                                  bool dmem_read, bool dmem_write,                              // in, control
+                                  uint64_t *dmem_rval, bool *dmem_err);                         // out
 #endif
\ No newline at end of file
@@ -205,6 +205,13 @@ typedef struct instr_impl {
     uint32_t        insnbits;
     opcode_t        op;
     uint64_t        seq_succ_PC;
+    // The following fields are written by the F logic for branches, and carried to X where the branch resolves.
+    uint64_t        target_PC; // Taken target of B, B.cond and BL; predicted target of RET.
+    uint64_t        pred_hist; // Global history the direction was predicted with.
+    bool            pred_dir; // Direction from the predictor.
+    bool            pred_taken; // Whether F went on to target_PC, which needs a BTB hit too.
+    uint16_t        ras_tos; // Top of the return address stack after this instruction.
+    uint16_t        ras_count; // Entries on the return address stack after this instruction.
     // The following fields are written by the D logic to d_insn->out and can be used by the logic in X, M, and W.
     x_ctl_sigs_t    X_sigs;
     m_ctl_sigs_t    M_sigs;
@@ -235,6 +242,5 @@ extern void decode_instr(pipe_reg_t *const);
 extern void execute_instr(pipe_reg_t *const);
 extern void memory_instr(pipe_reg_t *const);
 extern void wback_instr(pipe_reg_t *const);
-extern void show_instr(const instr_impl_t *, const proc_stage_t, int debug_level);
 extern void init_itable(void);
 #endif
\ No newline at end of file
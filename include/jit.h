@@ -0,0 +1,13 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+#define JIT_CODE_SIZE (16 << 20)  // Bytes of host code before a flush.
+#define JIT_BLOCKS 4096           // Direct-mapped table of translated blocks.
+#define JIT_MAX_BLOCK 64          // Guest instructions per block.
+
+extern void jit_run(uint64_t *PC, const uint64_t max_instr, const uint64_t stop_PC,
+                    uint64_t *num_instr);
+extern void jit_flush(void);
+#endif
@@ -2,6 +2,7 @@
 #define _MEM_H_
 
 #include <stdint.h>
+#include "perf.h"
 // #include "cache/cache.h"
 // Memory state.
 typedef enum {
@@ -26,6 +27,11 @@ typedef enum {
     ERROR_SEG = -1
 } seg_t;
 
+// Protection bits kept in seg_prot[] and in each page-table entry.
+#define PROT_X 0x1
+#define PROT_W 0x2
+#define PROT_R 0x4
+
 typedef struct mem {
     unsigned long long max_addr;
     unsigned addr_size;
@@ -46,6 +52,8 @@ extern short     mem_read_S (uint64_t address);
 extern int       mem_read_I (uint64_t address);
 extern long      mem_read_L (uint64_t address);
 extern long long mem_read_LL(uint64_t address);
+// Fetch the instruction at address, faulting unless it is executable.
+extern uint32_t  mem_read_insn(uint64_t address);
 
 typedef enum write_ret_code {
     WRITE_FAILURE,
@@ -59,6 +67,23 @@ extern write_ret_code_t mem_write_I (uint64_t address, int       data);
 extern write_ret_code_t mem_write_L (uint64_t address, long      data);
 extern write_ret_code_t mem_write_LL(uint64_t address, long long data);
 
+// Map a range of guest memory with the given protection.
+extern void mem_map(uint64_t address, uint64_t len, uint8_t prot);
+// Load a program segment, zero-filling from filesz up to memsz.
+extern void mem_load(uint64_t address, const uint8_t *data, uint64_t filesz, uint64_t memsz);
+
+// Fetch through the L1I, setting imem_status.
+extern void mem_fetch(const uint64_t addr);
+// Skipping the cycles of a data or instruction cache miss in flight.
+extern uint64_t mem_inflight_cycles(void);
+extern uint64_t mem_fetch_cycles(void);
+extern void mem_skip_inflight(const uint64_t n);
+extern void mem_skip_fetch(const uint64_t n);
+extern perf_cause_t mem_inflight_cause(void);
+// Move a cache block between guest memory and a line.
+extern void mem_read_block(const uint64_t addr, uint8_t *data, const unsigned len);
+extern void mem_write_block(const uint64_t addr, const uint8_t *data, const unsigned len);
+
 extern const uint64_t NULL_ADDR;
 extern const uint64_t IO_CHAR_ADDR;
 extern const uint64_t RET_FROM_MAIN_ADDR;
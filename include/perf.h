@@ -0,0 +1,33 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+#include <stdio.h>
+#include <stdint.h>
+
+/* Causes of a cycle in which no instruction retires. Every cycle of the
+ * pipeline either retires one instruction or is charged to exactly one
+ * of these, so cycles == retired + the sum of lost[].
+ */
+typedef enum perf_cause {
+    CPI_LOAD_USE,   // D bubbled behind a load in X.
+    CPI_MISPREDICT, // Wrong-path instruction squashed by a B.cond in X.
+    CPI_MISFETCH,   // F bubbled behind a B or BL that missed in the BTB.
+    CPI_RET,        // F bubbled behind a RET the RAS did not predict.
+    CPI_L2,         // Stalled on an L1D miss that hits in the L2,
+    CPI_L3,         // or in the L3,
+    CPI_MEM,        // or goes to memory.
+    CPI_ICACHE,     // F bubbled on an L1I miss.
+    CPI_FILL,       // Pipeline fill at startup, and drain before the functional model.
+    CPI_CAUSES
+} perf_cause_t;
+
+typedef struct perf_counters {
+    uint64_t cycles;
+    uint64_t retired;
+    uint64_t lost[CPI_CAUSES];
+} perf_counters_t;
+
+extern const perf_counters_t *perf_get(void);
+extern void perf_reset(void);
+extern double perf_cpi(void);
+extern void perf_print(FILE *);
+#endif
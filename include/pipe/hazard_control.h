@@ -1,7 +1,10 @@
 
 #include <stdint.h>
 
-bool check_ret_hazard(opcode_t D_opcode);
-bool check_mispred_branch_hazard(opcode_t X_opcode, bool X_condval);
+extern perf_cause_t bubble_cause[];
+
+bool check_ret_hazard(opcode_t D_opcode, bool D_pred_taken, uint64_t D_target, uint64_t D_val_a);
+bool check_mispred_branch_hazard(opcode_t X_opcode, bool X_condval, bool X_pred_taken);
+bool check_misfetch_hazard(opcode_t D_opcode, bool D_pred_taken);
 bool check_load_use_hazard(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2, opcode_t X_opcode, uint8_t X_dst);
 void handle_hazards(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2, opcode_t X_opcode, uint8_t X_dst, bool X_condval);
\ No newline at end of file
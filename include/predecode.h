@@ -0,0 +1,41 @@
+#ifndef _PREDECODE_H_
+#define _PREDECODE_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "instr.h"
+
+#define PREDECODE_SIZE 4096
+
+/* Direct-mapped cache of decoded instructions, indexed by PC. Fetch fills
+ * pd_insnbits and pd_op; the remaining fields are filled the first time
+ * the instruction reaches decode, since they depend only on the bits.
+ */
+typedef struct predecode_entry {
+    bool pd_valid;
+    uint64_t pd_PC;
+    uint32_t pd_insnbits;
+    opcode_t pd_op;
+    uint64_t pd_target; // Branch target of B, B.cond and BL; PC+4 otherwise.
+    bool pd_decoded;
+    d_ctl_sigs_t pd_D_sigs;
+    x_ctl_sigs_t pd_X_sigs;
+    m_ctl_sigs_t pd_M_sigs;
+    w_ctl_sigs_t pd_W_sigs;
+    alu_op_t pd_ALU_op;
+    cond_t pd_cond;
+    bool pd_has_imm; // Opcodes without an immediate get val_imm 0.
+    int64_t pd_imm;
+    uint8_t pd_hw;
+    uint8_t pd_src1;
+    uint8_t pd_src2;
+    uint8_t pd_dst;
+} predecode_entry_t, *predecode_ptr_t;
+
+extern predecode_ptr_t predecode_lookup(const uint64_t);
+extern predecode_ptr_t predecode_fill(const uint64_t, const uint32_t, const opcode_t);
+extern void predecode_invalidate_page(const uint64_t);
+extern void predecode_flush(void);
+
+// Defined in instr.c, which owns the decode logic.
+extern predecode_ptr_t predecode_at(uint64_t);
+#endif
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include "reg.h"
 #include "instr.h"
+#include "perf.h"
 
 // Processor state.
 typedef struct proc {
@@ -17,7 +18,13 @@ typedef struct proc {
     pipe_reg_t *x_insn;
     pipe_reg_t *m_insn;
     pipe_reg_t *w_insn;
+
+    perf_counters_t perf; // Accumulated over every run of the pipeline.
 } proc_t;
 
 extern int runElf(const uint64_t);
+extern bool runFunctional(const uint64_t, const uint64_t, uint64_t *);
+extern void reset_pipeline(void);
+extern bool run_pipeline(const uint64_t, const uint64_t, const uint64_t, uint64_t *, uint64_t *);
+extern bool drain_pipeline(uint64_t *, uint64_t *);
 #endif
\ No newline at end of file
@@ -1,16 +1,23 @@
 #ifndef _PTABLE_H_
 #define _PTABLE_H_
 #include <stdint.h>
+#include <stdbool.h>
+#include "mem.h"
 
 #define PAGESIZE 4096
 
 typedef struct pte {
     uint64_t p_num;
     unsigned p_prot;
+    byte_order_t p_order;
+    bool p_zero;    // p_data is the shared zero page; copy on first write.
+    bool p_code;    // Instructions on this page are in the predecode cache.
     char *p_data;
-    struct pte *p_next;
 } pte_t, *pte_ptr_t;
 
 extern pte_ptr_t get_page(const uint64_t);
-extern pte_ptr_t add_page(const uint64_t, const uint8_t);
+extern pte_ptr_t add_page(const uint64_t, const uint8_t, const byte_order_t);
+extern pte_ptr_t add_zero_page(const uint64_t, const uint8_t, const byte_order_t);
+extern void cow_page(const pte_ptr_t);
+extern void free_ptable(void);
 #endif
\ No newline at end of file
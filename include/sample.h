@@ -0,0 +1,16 @@
+#ifndef _SAMPLE_H_
+#define _SAMPLE_H_
+#include <stdio.h>
+#include <stdint.h>
+#include "instr.h"
+
+// Maximum number of distinct basic blocks tracked for BBV output.
+#define BBV_SIZE (1 << 16)
+
+// Basic-block vectors are written here, one line per sampling period.
+extern FILE *bbv_file;
+
+extern void runSampled(void);
+extern void bbv_retire(const uint64_t, const opcode_t);
+extern void bbv_interval_end(void);
+#endif
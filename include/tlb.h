@@ -0,0 +1,24 @@
+#ifndef _TLB_H_
+#define _TLB_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "ptable.h"
+
+#define TLB_SIZE 256
+
+// Direct-mapped software TLB entry, caching a page-table lookup.
+typedef struct tlb_entry {
+    bool t_valid;
+    uint64_t t_pnum;
+    unsigned t_prot;
+    byte_order_t t_order;
+    bool t_zero;
+    bool t_code;
+    char *t_data;
+} tlb_entry_t, *tlb_entry_ptr_t;
+
+extern tlb_entry_ptr_t tlb_lookup(const uint64_t);
+extern tlb_entry_ptr_t tlb_fill(const pte_ptr_t);
+extern void tlb_invalidate(const uint64_t);
+extern void tlb_flush(void);
+#endif
@@ -0,0 +1,78 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Pipeline tracing. The tracepoint in the cycle loop captures the output
+ * side of every pipeline register into one fixed-size record. Records are
+ * printed as text for -v, written in binary to the file given with -T, or
+ * both. tracedump turns a binary trace back into the -v text.
+ *
+ * Without -DTRACE the tracepoint expands to nothing, and -v and -T are
+ * accepted but have no effect.
+ */
+
+#define TRACE_MAGIC "A64TRC\0\1"
+#define TRACE_BUFSIZE (1 << 20) // Bytes of records held before a write.
+
+// Bits of trace_stage_t.ts_flags.
+#define TS_BUBBLE     (1 << 0)
+#define TS_STALL      (1 << 1)
+#define TS_VALB_SEL   (1 << 2)
+#define TS_SET_CC     (1 << 3)
+#define TS_DMEM_READ  (1 << 4)
+#define TS_DMEM_WRITE (1 << 5)
+#define TS_DST_31ISSP (1 << 6)
+#define TS_DST_SEL    (1 << 7)
+#define TS_WVAL_SEL   (1 << 8)
+#define TS_W_ENABLE   (1 << 9)
+
+typedef struct trace_stage {
+    uint64_t ts_seq_succ_PC;
+    uint64_t ts_val_a;
+    uint64_t ts_val_b;
+    uint64_t ts_val_imm;
+    uint64_t ts_val_ex;
+    uint64_t ts_val_mem;
+    uint32_t ts_insnbits;
+    uint16_t ts_flags;
+    uint8_t ts_op;
+    uint8_t ts_ALU_op;
+    uint8_t ts_cond;
+    uint8_t ts_dst;
+    uint8_t ts_hw;
+    uint8_t ts_pad;
+} trace_stage_t;
+
+typedef struct trace_rec {
+    uint64_t tr_cycle;
+    uint64_t tr_PC;      // Architectural PC as F leaves it.
+    uint64_t tr_pred_PC;
+    uint8_t tr_condval;  // X_condval.
+    uint8_t tr_pad[7];
+    trace_stage_t tr_stage[5]; // Indexed by proc_stage_t.
+} trace_rec_t;
+
+// A binary trace is this header followed by trace_rec_t records.
+typedef struct trace_header {
+    char th_magic[8];
+    uint32_t th_rec_size;
+    uint32_t th_pad;
+} trace_header_t;
+
+extern void trace_print(FILE *, const trace_rec_t *, const int level);
+
+#ifdef TRACE
+// Set while -v or -T is in effect.
+extern bool trace_on;
+
+extern bool trace_open(const char *fileName);
+extern void trace_cycle(const uint64_t cycle);
+#define TRACE_CYCLE(cycle) do { if (trace_on) trace_cycle(cycle); } while (0)
+#define TRACE_ACTIVE trace_on
+#else
+#define TRACE_CYCLE(cycle) ((void) 0)
+#define TRACE_ACTIVE false
+#endif
+#endif
@@ -17,10 +17,23 @@ FILE *infile, *outfile, *errfile;
 char *infile_name;
 char *ae_prompt;
 int debug_level;
+uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+uint64_t max_retired;
+uint64_t stop_PC;
+char *stop_symbol;
+uint64_t ff_instr;
+uint64_t ff_PC;
+bool functional_only;
+bool use_jit = true;
+uint64_t sample_period;
+uint64_t sample_warm = 2000;
+uint64_t sample_unit = 1000;
 uint64_t inflight_cycles;
 uint64_t inflight_addr;
 bool inflight;
+perf_cause_t inflight_cause;
 mem_status_t dmem_status;
+mem_status_t imem_status;
 
 int main(int argc, char* argv[]) {
     debug_level = 0;
@@ -28,6 +41,12 @@ int main(int argc, char* argv[]) {
     init();
     
     uint64_t entry = loadElf(infile_name);
+    if (stop_symbol != NULL && !lookupSymbol(stop_symbol, &stop_PC)) {
+        char printbuf[BUF_LEN];
+        snprintf(printbuf, BUF_LEN - 20, "symbol %s not found", stop_symbol);
+        logging(LOG_FATAL, printbuf);
+        exit(EXIT_FAILURE);
+    }
     int ret = runElf(entry);
     
     finalize();
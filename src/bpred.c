@@ -0,0 +1,403 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * bpred.c - Branch prediction for the fetch stage: a direction predictor
+ * for B.cond, chosen with -P, an optional branch target buffer, and an
+ * optional return address stack.
+ *
+ * F predicts with the global history of the branches ahead of it in the
+ * pipeline, and each branch carries that history down to X. The tables
+ * and the committed history are updated only as a branch retires, so a
+ * wrong-path branch leaves no trace.
+ *
+ * The return address stack is circular. F pushes and pops it, and every
+ * instruction carries the top and depth it left behind, so fetch can
+ * resume from any instruction in flight. Entries written on a wrong path
+ * are repaired from a committed copy when X finds a mispredict. A push
+ * onto a full stack overwrites the oldest entry, and a RET with the stack
+ * empty gets no prediction.
+ **************************************************************************/
+
+#include <string.h>
+#include "archsim.h"
+#include "bpred.h"
+
+bpred_kind_t bpred_kind = BP_TAKEN;
+unsigned bpred_bits = BPRED_DEFAULT_BITS;
+unsigned btb_bits;
+unsigned ras_depth;
+bool bpred_report;
+
+static const char *bpred_names[] = { "taken", "bimodal", "gshare", "tage" };
+
+// History lengths of the tagged TAGE tables, shortest first.
+static const unsigned tage_hist_len[TAGE_TABLES] = { 4, 12, 24, 48 };
+
+typedef struct tage_entry {
+    bool te_valid;
+    uint8_t te_tag;
+    uint8_t te_ctr;    // 3-bit counter, taken from 4 up.
+    uint8_t te_useful; // 2-bit usefulness.
+} tage_entry_t;
+
+typedef struct btb_entry {
+    bool btb_valid;
+    uint64_t btb_PC;
+} btb_entry_t;
+
+static uint8_t *counters;  // 2-bit counters of bimodal, gshare and the TAGE base.
+static tage_entry_t *tage[TAGE_TABLES];
+static unsigned tage_bits; // log2 of the entries in each tagged table.
+static uint64_t tage_updates;
+static btb_entry_t *btb;
+static uint64_t ghr;       // Committed global history, newest branch in bit 0.
+static uint64_t *ras, *ras_commit;
+static uint16_t ras_commit_tos, ras_commit_count;
+
+static uint64_t num_cond, num_cond_correct, num_mispred;
+static uint64_t num_btb_lookups, num_btb_hits;
+static uint64_t num_ret, num_ras_hits, num_ras_underflows;
+
+/*
+ * Parse a -P spec of the form <predictor>[:<bits>][,btb:<bits>][,ras:<depth>],
+ * where the bits are log2 of the table sizes. Returns false if it is
+ * malformed.
+ */
+
+bool bpred_configure(const char *spec) {
+    char buf[BUF_LEN], *tok, *save;
+    if (strlen(spec) >= BUF_LEN)
+        return false;
+    strcpy(buf, spec);
+    bpred_report = true;
+
+    for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *bits = strchr(tok, ':');
+        unsigned long n = 0;
+        if (bits != NULL) {
+            char *end;
+            *bits++ = '\0';
+            n = strtoul(bits, &end, 0);
+            if (*end != '\0')
+                return false;
+        }
+        if (strcmp(tok, "btb") == 0) {
+            btb_bits = (bits != NULL) ? n : 9;
+            if (btb_bits > BPRED_MAX_BITS)
+                return false;
+            continue;
+        }
+        if (strcmp(tok, "ras") == 0) {
+            ras_depth = (bits != NULL) ? n : RAS_DEFAULT_DEPTH;
+            if (ras_depth > RAS_MAX_DEPTH)
+                return false;
+            continue;
+        }
+        bpred_kind = BP_NONE;
+        for (int k = BP_TAKEN; k <= BP_TAGE; k++) {
+            if (strcmp(tok, bpred_names[k]) == 0)
+                bpred_kind = k;
+        }
+        if (bpred_kind == BP_NONE || (bits != NULL && (n < 4 || n > BPRED_MAX_BITS)))
+            return false;
+        if (bits != NULL)
+            bpred_bits = n;
+    }
+    return true;
+}
+
+void bpred_init(void) {
+    free(counters);
+    for (int i = 0; i < TAGE_TABLES; i++) {
+        free(tage[i]);
+        tage[i] = NULL;
+    }
+    free(btb);
+    free(ras);
+    free(ras_commit);
+
+    // Counters start weakly taken.
+    counters = malloc(1UL << bpred_bits);
+    memset(counters, 2, 1UL << bpred_bits);
+    if (bpred_kind == BP_TAGE) {
+        tage_bits = bpred_bits - 2;
+        for (int i = 0; i < TAGE_TABLES; i++)
+            tage[i] = calloc(1UL << tage_bits, sizeof(tage_entry_t));
+    }
+    btb = btb_bits ? calloc(1UL << btb_bits, sizeof(btb_entry_t)) : NULL;
+    ras = ras_depth ? calloc(ras_depth, sizeof(uint64_t)) : NULL;
+    ras_commit = ras_depth ? calloc(ras_depth, sizeof(uint64_t)) : NULL;
+    ras_commit_tos = ras_commit_count = 0;
+    ghr = 0;
+    tage_updates = 0;
+    num_cond = num_cond_correct = num_mispred = 0;
+    num_btb_lookups = num_btb_hits = 0;
+    num_ret = num_ras_hits = num_ras_underflows = 0;
+}
+
+uint64_t bpred_history(void) {
+    return ghr;
+}
+
+static inline uint64_t pc_index(const uint64_t PC) {
+    return PC >> 2;
+}
+
+// The low len bits of hist, xor-folded down to bits bits.
+static uint64_t fold(uint64_t hist, const unsigned len, const unsigned bits) {
+    uint64_t r = 0;
+    if (len < 64)
+        hist &= (1UL << len) - 1;
+    while (hist != 0) {
+        r ^= hist & ((1UL << bits) - 1);
+        hist >>= bits;
+    }
+    return r;
+}
+
+static inline uint64_t counter_index(const uint64_t PC, const uint64_t hist) {
+    uint64_t idx = pc_index(PC);
+    if (bpred_kind == BP_GSHARE)
+        idx ^= fold(hist, bpred_bits, bpred_bits);
+    return idx & ((1UL << bpred_bits) - 1);
+}
+
+static inline tage_entry_t *tage_entry(const int t, const uint64_t PC, const uint64_t hist) {
+    uint64_t idx = pc_index(PC) ^ (pc_index(PC) >> tage_bits) ^
+                   fold(hist, tage_hist_len[t], tage_bits);
+    return &tage[t][idx & ((1UL << tage_bits) - 1)];
+}
+
+static inline uint8_t tage_tag(const int t, const uint64_t PC, const uint64_t hist) {
+    return (pc_index(PC) ^ fold(hist, tage_hist_len[t], TAGE_TAG_BITS) ^
+            (fold(hist, tage_hist_len[t], TAGE_TAG_BITS - 1) << 1)) & ((1 << TAGE_TAG_BITS) - 1);
+}
+
+/*
+ * Find the longest-history TAGE table that matches, and the next longest
+ * after it. -1 stands for the base predictor.
+ */
+
+static void tage_match(const uint64_t PC, const uint64_t hist, int *provider, int *alt) {
+    *provider = *alt = -1;
+    for (int t = TAGE_TABLES - 1; t >= 0; t--) {
+        tage_entry_t *e = tage_entry(t, PC, hist);
+        if (e->te_valid && e->te_tag == tage_tag(t, PC, hist)) {
+            if (*provider < 0) {
+                *provider = t;
+            } else {
+                *alt = t;
+                return;
+            }
+        }
+    }
+}
+
+static bool tage_predict(const int t, const uint64_t PC, const uint64_t hist) {
+    if (t < 0)
+        return counters[counter_index(PC, hist)] >= 2;
+    return tage_entry(t, PC, hist)->te_ctr >= 4;
+}
+
+/*
+ * Predicted direction of the B.cond at PC, given the global history of
+ * the branches before it.
+ */
+
+bool bpred_direction(const uint64_t PC, const uint64_t hist) {
+    int provider, alt;
+    switch (bpred_kind) {
+        case BP_BIMODAL:
+        case BP_GSHARE:
+            return counters[counter_index(PC, hist)] >= 2;
+        case BP_TAGE:
+            tage_match(PC, hist, &provider, &alt);
+            return tage_predict(provider, PC, hist);
+        default:
+            return true;
+    }
+}
+
+/*
+ * Whether the BTB holds the branch at PC. Direct branches always have the
+ * same target, so a hit supplies the target from predecode. With no BTB,
+ * every lookup hits.
+ */
+
+bool btb_lookup(const uint64_t PC) {
+    if (btb == NULL)
+        return true;
+    btb_entry_t *e = &btb[pc_index(PC) & ((1UL << btb_bits) - 1)];
+    return e->btb_valid && e->btb_PC == PC;
+}
+
+static void ras_do_push(uint64_t *stack, uint16_t *tos, uint16_t *count, const uint64_t ret_PC) {
+    *tos = (*tos + 1) % ras_depth;
+    stack[*tos] = ret_PC;
+    if (*count < ras_depth)
+        (*count)++;
+}
+
+static bool ras_do_pop(const uint64_t *stack, uint16_t *tos, uint16_t *count, uint64_t *target) {
+    if (*count == 0)
+        return false;
+    *target = stack[*tos];
+    *tos = (*tos + ras_depth - 1) % ras_depth;
+    (*count)--;
+    return true;
+}
+
+// Top and depth of the stack once every retired call and return is applied.
+void ras_committed(uint16_t *tos, uint16_t *count) {
+    *tos = ras_commit_tos;
+    *count = ras_commit_count;
+}
+
+/*
+ * Push the return address of a BL fetched with the stack at *tos and
+ * *count, and update them. Fetching the same BL again after a stall
+ * writes the same entry.
+ */
+
+void ras_push(uint16_t *tos, uint16_t *count, const uint64_t ret_PC) {
+    if (ras != NULL)
+        ras_do_push(ras, tos, count, ret_PC);
+}
+
+/*
+ * Pop the predicted target of a RET. Returns false, leaving the stack
+ * alone, if there is no RAS or it is empty.
+ */
+
+bool ras_pop(uint16_t *tos, uint16_t *count, uint64_t *target) {
+    return ras != NULL && ras_do_pop(ras, tos, count, target);
+}
+
+void ras_recover(void) {
+    if (ras != NULL)
+        memcpy(ras, ras_commit, ras_depth * sizeof(uint64_t));
+}
+
+static inline void counter_update(uint8_t *ctr, const bool taken, const uint8_t max) {
+    if (taken && *ctr < max)
+        (*ctr)++;
+    else if (!taken && *ctr > 0)
+        (*ctr)--;
+}
+
+static void tage_update(const uint64_t PC, const uint64_t hist, const bool taken) {
+    int provider, alt;
+    tage_match(PC, hist, &provider, &alt);
+    bool pred = tage_predict(provider, PC, hist);
+
+    if (provider >= 0) {
+        tage_entry_t *e = tage_entry(provider, PC, hist);
+        if (pred != tage_predict(alt, PC, hist))
+            counter_update(&e->te_useful, pred == taken, 3);
+        counter_update(&e->te_ctr, taken, 7);
+    } else {
+        counter_update(&counters[counter_index(PC, hist)], taken, 3);
+    }
+
+    // On a mispredict, claim an entry in a table with a longer history.
+    if (pred != taken) {
+        bool allocated = false;
+        for (int t = provider + 1; t < TAGE_TABLES && !allocated; t++) {
+            tage_entry_t *e = tage_entry(t, PC, hist);
+            if (e->te_useful == 0) {
+                e->te_valid = true;
+                e->te_tag = tage_tag(t, PC, hist);
+                e->te_ctr = taken ? 4 : 3;
+                allocated = true;
+            }
+        }
+        for (int t = provider + 1; t < TAGE_TABLES && !allocated; t++) {
+            tage_entry_t *e = tage_entry(t, PC, hist);
+            if (e->te_useful > 0)
+                e->te_useful--;
+        }
+    }
+
+    // Age the usefulness bits now and then, so stale entries can be replaced.
+    if ((++tage_updates & ((1UL << 18) - 1)) == 0) {
+        for (int t = 0; t < TAGE_TABLES; t++) {
+            for (uint64_t i = 0; i < (1UL << tage_bits); i++)
+                tage[t][i].te_useful >>= 1;
+        }
+    }
+}
+
+/*
+ * Train the predictor and BTB with a branch as it retires from X, and
+ * count how it was predicted.
+ */
+
+void bpred_resolve(const instr_impl_t *insn, const bool taken) {
+    uint64_t PC = insn->seq_succ_PC - 4;
+
+    if (insn->pred_dir) {
+        num_btb_lookups++;
+        if (insn->pred_taken)
+            num_btb_hits++;
+    }
+    if (insn->op == OP_B_COND) {
+        num_cond++;
+        if (insn->pred_dir == taken)
+            num_cond_correct++;
+        if (insn->pred_taken != taken)
+            num_mispred++;
+
+        switch (bpred_kind) {
+            case BP_BIMODAL:
+            case BP_GSHARE:
+                counter_update(&counters[counter_index(PC, insn->pred_hist)], taken, 3);
+                break;
+            case BP_TAGE:
+                tage_update(PC, insn->pred_hist, taken);
+                break;
+            default:
+                break;
+        }
+        ghr = (insn->pred_hist << 1) | taken;
+    }
+    if (insn->op == OP_BL && ras != NULL) {
+        ras_do_push(ras_commit, &ras_commit_tos, &ras_commit_count, insn->seq_succ_PC);
+    } else if (insn->op == OP_RET) {
+        // RET passes its target through the ALU.
+        uint64_t target;
+        num_ret++;
+        if (insn->pred_taken && insn->target_PC == insn->val_ex)
+            num_ras_hits++;
+        if (ras != NULL && !ras_do_pop(ras_commit, &ras_commit_tos, &ras_commit_count, &target))
+            num_ras_underflows++;
+        return;
+    }
+    if (btb != NULL && taken) {
+        btb_entry_t *e = &btb[pc_index(PC) & ((1UL << btb_bits) - 1)];
+        e->btb_valid = true;
+        e->btb_PC = PC;
+    }
+}
+
+static double percent(const uint64_t n, const uint64_t d) {
+    return d ? 100.0 * n / d : 0.0;
+}
+
+void bpred_print_stats(FILE *f) {
+    fprintf(f, "Branch predictor: %s, %lu counters\n", bpred_names[bpred_kind],
+            (bpred_kind == BP_TAKEN) ? 0UL : (1UL << bpred_bits));
+    fprintf(f, "  B.cond: %lu retired, %lu directions correct (%.2f%%), %lu mispredicts\n",
+            num_cond, num_cond_correct, percent(num_cond_correct, num_cond), num_mispred);
+    if (btb == NULL)
+        fprintf(f, "  BTB: none, targets known at fetch\n");
+    else
+        fprintf(f, "  BTB: %lu entries, %lu lookups, %lu hits (%.2f%%)\n",
+                1UL << btb_bits, num_btb_lookups, num_btb_hits,
+                percent(num_btb_hits, num_btb_lookups));
+    if (ras == NULL)
+        fprintf(f, "  RAS: none, RET waits for its target\n");
+    else
+        fprintf(f, "  RAS: depth %u, %lu returns, %lu hits (%.2f%%), %lu misses, %lu underflows\n",
+                ras_depth, num_ret, num_ras_hits, percent(num_ras_hits, num_ret),
+                num_ret - num_ras_hits, num_ras_underflows);
+}
@@ -1,7 +1,8 @@
 /*
  * cache.c - A cache simulator that can replay traces from Valgrind
  *     and output statistics such as number of hits, misses, and
- *     evictions, both dirty and clean.  The replacement policy is LRU. 
+ *     evictions, both dirty and clean.  The replacement policy is LRU
+ *     unless repl_policy says otherwise (see repl.c).
  *     The cache is a writeback cache. 
  * 
  * Updated 2021: M. Hinton
@@ -15,6 +16,11 @@
 #include <string.h>
 #include <errno.h>
 #include "cache.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define ADDRESS_LENGTH 64
 
@@ -34,7 +40,37 @@ int dirty_eviction_count = 0;
 int clean_eviction_count = 0;
 
 /* TODO: add more globals, structs, macros if necessary */
-uword_t next_lru;
+
+/* Tag store entries and valid-bit words per set */
+#define TAG_WAYS(E) (((E) + TAG_CHUNK - 1) / TAG_CHUNK * TAG_CHUNK)
+#define VALID_WORDS(E) (((E) + 63) / 64)
+
+static bool way_valid(const cache_set_t *set, unsigned int way) {
+    return (set->valid[way / 64] >> (way % 64)) & 1;
+}
+
+static cache_set_t *get_set(cache_t *cache, uword_t addr) {
+    return &cache->sets[(addr >> cache->b) & ((1 << cache->s) - 1)];
+}
+
+/* Allocate the tag store and replacement metadata of a cache with the
+ * geometry and policy already set, with every way invalid, and point each
+ * set at its part of them.
+ */
+static void alloc_tag_store(cache_t *cache) {
+    size_t S = (size_t) 1 << cache->s;
+    size_t W = TAG_WAYS(cache->E), V = VALID_WORDS(cache->E);
+    size_t R = repl_words(cache->policy, cache->E);
+    cache->tag_store = aligned_alloc(TAG_ALIGN, S * W * sizeof(uword_t));
+    memset(cache->tag_store, 0, S * W * sizeof(uword_t));
+    cache->valid_store = calloc(S * V, sizeof(uword_t));
+    cache->repl_store = R ? calloc(S * R, sizeof(uword_t)) : NULL;
+    for (size_t i = 0; i < S; i++) {
+        cache->sets[i].tags = &cache->tag_store[i * W];
+        cache->sets[i].valid = &cache->valid_store[i * V];
+        cache->sets[i].repl = R ? &cache->repl_store[i * R] : NULL;
+    }
+}
 
 /*
  * Initialize the cache according to specified arguments
@@ -50,24 +86,26 @@ cache_t *create_cache(int s_in, int b_in, int E_in, int d_in) {
     cache->b = b_in;
     cache->E = E_in;
     cache->d = d_in;
+    cache->policy = repl_policy;
+    cache->repl_clock = 0;
+    cache->repl_rng = REPL_SEED;
     unsigned int S = (unsigned int) 1 << cache->s;
     unsigned int B = (unsigned int) 1 << cache->b;
 
     cache->sets = (cache_set_t*) calloc(S, sizeof(cache_set_t));
+    alloc_tag_store(cache);
     for (unsigned int i = 0; i < S; i++){
         cache->sets[i].lines = (cache_line_t*) calloc(cache->E, sizeof(cache_line_t));
         for (unsigned int j = 0; j < cache->E; j++){
-            cache->sets[i].lines[j].valid = 0;
-            cache->sets[i].lines[j].tag   = 0;
-            cache->sets[i].lines[j].lru   = 0;
             cache->sets[i].lines[j].dirty = 0;
             cache->sets[i].lines[j].data  = calloc(B, sizeof(byte_t));
         }
     }
+    cache->evicted.valid = false;
+    cache->evicted.data = calloc(B, sizeof(byte_t));
 
     /* TODO: add more code for initialization */
     // only need to edit if we create more global variables
-    next_lru = 0;
     return cache;
 }
 
@@ -77,6 +115,12 @@ cache_t *create_checkpoint(cache_t *cache) {
     cache_t *copy_cache = malloc(sizeof(cache_t));
     memcpy(copy_cache, cache, sizeof(cache_t));
     copy_cache->sets = (cache_set_t*) calloc(S, sizeof(cache_set_t));
+    alloc_tag_store(copy_cache);
+    memcpy(copy_cache->tag_store, cache->tag_store, S * TAG_WAYS(cache->E) * sizeof(uword_t));
+    memcpy(copy_cache->valid_store, cache->valid_store, S * VALID_WORDS(cache->E) * sizeof(uword_t));
+    if (cache->repl_store != NULL)
+        memcpy(copy_cache->repl_store, cache->repl_store,
+               S * repl_words(cache->policy, cache->E) * sizeof(uword_t));
     for (unsigned int i = 0; i < S; i++) {
         copy_cache->sets[i].lines = (cache_line_t*) calloc(cache->E, sizeof(cache_line_t));
         for (unsigned int j = 0; j < cache->E; j++) {
@@ -85,6 +129,8 @@ cache_t *create_checkpoint(cache_t *cache) {
             memcpy(copy_cache->sets[i].lines[j].data, cache->sets[i].lines[j].data, sizeof(byte_t));
         }
     }
+    copy_cache->evicted.data = calloc(B, sizeof(byte_t));
+    memcpy(copy_cache->evicted.data, cache->evicted.data, B);
     
     return copy_cache;
 }
@@ -94,8 +140,8 @@ void display_set(cache_t *cache, unsigned int set_index) {
     if (set_index < S) {
         cache_set_t *set = &cache->sets[set_index];
         for (unsigned int i = 0; i < cache->E; i++) {
-            printf ("Valid: %d Tag: %llx Lru: %lld Dirty: %d\n", set->lines[i].valid, 
-                set->lines[i].tag, set->lines[i].lru, set->lines[i].dirty);
+            printf ("Valid: %d Tag: %llx Repl: %lld Dirty: %d\n", way_valid(set, i), 
+                set->tags[i], repl_state(cache, set, i), set->lines[i].dirty);
         }
     } else {
         printf ("Invalid Set %d. 0 <= Set < %d\n", set_index, S);
@@ -114,80 +160,90 @@ void free_cache(cache_t *cache) {
         free(cache->sets[i].lines);
     }
     free(cache->sets);
+    free(cache->tag_store);
+    free(cache->valid_store);
+    free(cache->repl_store);
+    free(cache->evicted.data);
     free(cache);
 }
 
+/* Return the way of set that holds tag, or -1 if none does. The tags are
+ * compared a chunk of ways at a time, with AVX2 or SSE2 when the compiler
+ * targets them, and the scan stops at the first chunk with a valid match.
+ */
+static int find_way(const cache_t *cache, const cache_set_t *set, uword_t tag) {
+#if defined(__AVX2__)
+    const __m256i key = _mm256_set1_epi64x((long long) tag);
+#elif defined(__SSE2__)
+    const __m128i key = _mm_set1_epi64x((long long) tag);
+#endif
+    for (unsigned int w = 0; w < cache->E; w += TAG_CHUNK) {
+        unsigned int match = 0;
+#if defined(__AVX2__)
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *) &set->tags[w]), key);
+        match = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+#elif defined(__SSE2__)
+        /* SSE2 has no 64-bit compare: a tag matches where both halves do */
+        for (unsigned int h = 0; h < TAG_CHUNK; h += 2) {
+            __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *) &set->tags[w + h]), key);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            match |= _mm_movemask_pd(_mm_castsi128_pd(eq)) << h;
+        }
+#else
+        for (unsigned int h = 0; h < TAG_CHUNK; h++)
+            match |= (set->tags[w + h] == tag) << h;
+#endif
+        /* A chunk never straddles two valid words */
+        match &= (set->valid[w / 64] >> (w % 64)) & ((1u << TAG_CHUNK) - 1);
+        if (match)
+            return w + __builtin_ctz(match);
+    }
+    return -1;
+}
+
 /* TODO:
  * Get the line for address contained in the cache
  * On hit, return the cache line holding the address
  * On miss, returns NULL
  */
 cache_line_t *get_line(cache_t *cache, uword_t addr) {
-    /* your implementation */
-    // uword_t tag = addr >> (cache->b + cache->s);
-    // unsigned int set_index = 0;
-    cache_line_t *line = NULL;
-    cache_set_t set = cache->sets[(addr >> cache->b) & ((1 << cache->s) -1)];
-    // int i = 0;
+    cache_set_t *set = get_set(cache, addr);
+    int way = find_way(cache, set, addr >> (cache->b + cache->s));
+    return (way < 0) ? NULL : &set->lines[way];
+}
 
-    for (int i = 0; i<cache->E; i++)
-    {
-        if (set.lines[i].valid && set.lines[i].tag == addr >> (cache->b + cache->s))
-        {
-            line = &(set.lines[i]);
-        }
+/*
+ * Drop the line holding addr, if any, without writing it back.
+ */
+void invalidate_line(cache_t *cache, uword_t addr) {
+    cache_set_t *set = get_set(cache, addr);
+    int way = find_way(cache, set, addr >> (cache->b + cache->s));
+    if (way >= 0) {
+        set->valid[way / 64] &= ~(1ULL << (way % 64));
+        set->lines[way].dirty = false;
     }
-    return line;
 }
 
 /* TODO:
- * Select the line to fill with the new cache line
- * Return the cache line selected to filled in by addr
+ * Select the way to fill with the new cache line: the first invalid way,
+ * or else the victim of the replacement policy, which is evicted.
  */
-cache_line_t *select_line(cache_t *cache, uword_t addr) {
-    /* your implementation */
-    // uword_t tag = addr >> (cache->b + cache->s);
-    // unsigned int set_index = 0;
-    cache_set_t set = cache->sets[(addr >> cache->b) & ((1 << cache->s) -1)];
-    cache_line_t *line = &set.lines[0];
-    uword_t lru = set.lines[0].lru;
-    bool evicted = true; //true
-    for (int i = 0; i < cache->E; i++)
-    {
-        if (!set.lines[i].valid)
-        {
-            evicted = false; //false
-            // printf("not evicted, found line\n");
-            return &set.lines[i];
-        }
-
-        else if (set.lines[i].lru < lru)
-        {
-            
-            // printf("evicted\n");
-            line = &set.lines[i];
-            lru = set.lines[i].lru;
-            // printf("(inside loop) dirty? %d\n", line->dirty);
+static unsigned int select_way(cache_t *cache, cache_set_t *set) {
+    for (unsigned int v = 0; v < VALID_WORDS(cache->E); v++) {
+        if (~set->valid[v] != 0) {
+            unsigned int way = v * 64 + __builtin_ctzll(~set->valid[v]);
+            if (way < cache->E)
+                return way;
+            break;
         }
     }
-    
-    if (evicted)
-    {
-        // printf("(outside loop) dirty? %d\n", line->dirty);
-        // printf("(outside loop) evicted? %d\n", evicted);
-        if (!line->dirty)
-        {
-            // printf("clean\n");
-            clean_eviction_count++;
-        }
-        else
-        {
-            // printf("dirty\n");
-            dirty_eviction_count++;
-        }
-    }
-    
-    return line;
+
+    unsigned int way = repl_victim(cache, set);
+    if (!set->lines[way].dirty)
+        clean_eviction_count++;
+    else
+        dirty_eviction_count++;
+    return way;
 }
 
 /* TODO:
@@ -195,36 +251,21 @@ cache_line_t *select_line(cache_t *cache, uword_t addr) {
  * Return true if pos hits in the cache.
  */
 bool check_hit(cache_t *cache, uword_t addr, operation_t operation) {
-    /* your implementation */
-    // uword_t tag = addr >> (cache->b + cache->s);
-    cache_line_t *line = get_line(cache, addr);
-    bool hit = false;
-    if (line != NULL)
+    cache_set_t *set = get_set(cache, addr);
+    int way = find_way(cache, set, addr >> (cache->b + cache->s));
+    if (way < 0)
     {
-        hit = true;
-    }
-    // printf("hit is %d \n", hit);
-    
-    if (!hit)
-    {
-        // line->dirty = operation == WRITE;
-        // printf("miss\n");
         miss_count++;
+        return false;
     }
-    else
+
+    if (operation != READ)
     {
-        if (operation != READ)
-        {
-            line->dirty = true;
-        }
-        // line->dirty = operation == WRITE;
-        hit_count++;
-        // printf("hit\n");
-        line->lru = next_lru;
-        next_lru++;
+        set->lines[way].dirty = true;
     }
-    
-    return hit;
+    hit_count++;
+    repl_touch(cache, set, way);
+    return true;
 }
 
 /*  TODO:
@@ -232,26 +273,27 @@ bool check_hit(cache_t *cache, uword_t addr, operation_t operation) {
  * Fill out the evicted_line_t struct with info regarding the evicted line.
  */
 evicted_line_t *handle_miss(cache_t *cache, uword_t addr, operation_t operation, byte_t *incoming_data) { 
-    evicted_line_t *evicted = malloc(sizeof(evicted_line_t));
-    cache_line_t *line = select_line(cache, addr);    
+    evicted_line_t *evicted = &cache->evicted;
+    cache_set_t *set = get_set(cache, addr);
+    unsigned int way = select_way(cache, set);
+    cache_line_t *line = &set->lines[way];
     unsigned int off = cache->s + cache->b;
-    evicted->data = calloc((1 << cache->b), sizeof(8));
-    memcpy(evicted->data, line->data, (1 << cache->b));
+    /* The victim keeps its block, and the line takes the spare one */
+    byte_t *spare = evicted->data;
+    evicted->data = line->data;
+    line->data = spare;
     evicted->dirty = line->dirty; 
-    evicted->valid = line->valid; 
-    
-    evicted->addr = (((addr >> cache->b) & ((1 << cache->s) - 1)) << cache->b) | (line->tag << off);
-    
-    line->lru = next_lru;
-    next_lru++;
+    evicted->valid = way_valid(set, way); 
     
+    evicted->addr = (((addr >> cache->b) & ((1 << cache->s) - 1)) << cache->b) | (set->tags[way] << off);
     
     if (incoming_data != NULL) {
         memcpy(line->data, incoming_data, (1 << cache->b));
     }
-    line->tag = addr >> off;
-    line->valid = 1;
+    set->tags[way] = addr >> off;
+    set->valid[way / 64] |= 1ULL << (way % 64);
     line->dirty = operation == WRITE;
+    repl_fill(cache, set, way);
     return evicted;
 }
 
@@ -305,5 +347,5 @@ void set_word_cache(cache_t *cache, uword_t addr, word_t val) {
  */
 void access_data(cache_t *cache, uword_t addr, operation_t operation) {
     if(!check_hit(cache, addr, operation))
-        free(handle_miss(cache, addr, operation, NULL));
+        handle_miss(cache, addr, operation, NULL);
 }
@@ -86,13 +86,15 @@ void replayTrace(cache_t *cache, char* trace_fn)
  */
 void printUsage(char* argv[])
 {
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> [-r <policy>] -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
     printf("  -s <num>   Number of set index bits.\n");
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -r <policy> Replacement policy: lru (default), plru, srrip, brrip,\n");
+    printf("             fifo or random.\n");
     printf("  -t <file>  Trace file.\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
@@ -107,7 +109,7 @@ int main(int argc, char* argv[])
 {
     int s = -1, E = -1, b = -1;
     char c;
-    while( (c=getopt(argc,argv,"s:E:b:t:vh")) != -1){
+    while( (c=getopt(argc,argv,"s:E:b:r:t:vh")) != -1){
         switch(c){
         case 's':
             s = atoi(optarg);
@@ -118,6 +120,13 @@ int main(int argc, char* argv[])
         case 'b':
             b = atoi(optarg);
             break;
+        case 'r':
+            if (!repl_parse(optarg, &repl_policy)) {
+                printf("%s: Unknown replacement policy %s\n", argv[0], optarg);
+                printUsage(argv);
+                exit(1);
+            }
+            break;
         case 't':
             trace_file = optarg;
             break;
@@ -145,9 +154,8 @@ int main(int argc, char* argv[])
     /* Initialize cache */
     cache_t *cache = create_cache(s, b, E, 0);
 
-#ifdef DEBUG_ON
-    printf("DEBUG: S:%u E:%u B:%u trace:%s\n", S, E, B, trace_file);
-    printf("DEBUG: set_index_mask: %llu\n", set_index_mask);
+#ifdef DEBUG
+    printf("DEBUG: s:%d E:%d b:%d trace:%s\n", s, E, b, trace_file);
 #endif
 
     replayTrace(cache, trace_file);
@@ -0,0 +1,209 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * repl.c - Replacement policies of the cache. Each policy keeps its state
+ * in the words at set->repl, and is told of every hit (repl_touch) and
+ * fill (repl_fill). repl_victim is only asked once every way is valid.
+ **************************************************************************/
+
+#include <string.h>
+#include "cache.h"
+
+repl_policy_t repl_policy = REPL_LRU;
+
+static const char *repl_names[] = {
+    [REPL_LRU] = "lru",
+    [REPL_PLRU] = "plru",
+    [REPL_SRRIP] = "srrip",
+    [REPL_BRRIP] = "brrip",
+    [REPL_FIFO] = "fifo",
+    [REPL_RANDOM] = "random",
+};
+
+bool repl_parse(const char *name, repl_policy_t *policy) {
+    for (int i = REPL_LRU; i <= REPL_RANDOM; i++) {
+        if (strcmp(name, repl_names[i]) == 0) {
+            *policy = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *repl_name(repl_policy_t policy) {
+    return repl_names[policy];
+}
+
+// Words of metadata per set.
+unsigned int repl_words(repl_policy_t policy, unsigned int E) {
+    switch (policy) {
+    case REPL_LRU:
+        return E;
+    case REPL_PLRU:
+        return (E - 1 + 63) / 64;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+        return (E * RRPV_BITS + 63) / 64;
+    case REPL_FIFO:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// xorshift64*
+static uword_t repl_rand(cache_t *cache) {
+    uword_t x = cache->repl_rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    cache->repl_rng = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static bool get_bit(const uword_t *words, unsigned int i) {
+    return (words[i / 64] >> (i % 64)) & 1;
+}
+
+static void put_bit(uword_t *words, unsigned int i, bool v) {
+    if (v)
+        words[i / 64] |= 1ULL << (i % 64);
+    else
+        words[i / 64] &= ~(1ULL << (i % 64));
+}
+
+static unsigned int get_rrpv(const cache_set_t *set, unsigned int way) {
+    unsigned int bit = way * RRPV_BITS;
+    return (set->repl[bit / 64] >> (bit % 64)) & RRPV_MAX;
+}
+
+static void put_rrpv(cache_set_t *set, unsigned int way, unsigned int rrpv) {
+    unsigned int bit = way * RRPV_BITS;
+    set->repl[bit / 64] &= ~((uword_t) RRPV_MAX << (bit % 64));
+    set->repl[bit / 64] |= (uword_t) rrpv << (bit % 64);
+}
+
+/* Tree-PLRU over any number of ways. The node splitting ways [lo, lo+n)
+ * into [lo, lo+n/2) and [lo+n/2, lo+n) is bit lo+n/2-1, and is set when
+ * the victim is on the right.
+ */
+static void plru_touch(cache_set_t *set, unsigned int E, unsigned int way) {
+    unsigned int lo = 0, n = E;
+    while (n > 1) {
+        unsigned int h = n / 2;
+        bool right = way >= lo + h;
+        put_bit(set->repl, lo + h - 1, !right);
+        if (right) {
+            lo += h;
+            n -= h;
+        } else {
+            n = h;
+        }
+    }
+}
+
+static unsigned int plru_victim(const cache_set_t *set, unsigned int E) {
+    unsigned int lo = 0, n = E;
+    while (n > 1) {
+        unsigned int h = n / 2;
+        if (get_bit(set->repl, lo + h - 1)) {
+            lo += h;
+            n -= h;
+        } else {
+            n = h;
+        }
+    }
+    return lo;
+}
+
+void repl_touch(cache_t *cache, cache_set_t *set, unsigned int way) {
+    switch (cache->policy) {
+    case REPL_LRU:
+        set->repl[way] = cache->repl_clock++;
+        break;
+    case REPL_PLRU:
+        plru_touch(set, cache->E, way);
+        break;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+        put_rrpv(set, way, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+void repl_fill(cache_t *cache, cache_set_t *set, unsigned int way) {
+    switch (cache->policy) {
+    case REPL_SRRIP:
+        put_rrpv(set, way, RRPV_MAX - 1);
+        break;
+    case REPL_BRRIP:
+        put_rrpv(set, way, (repl_rand(cache) % BRRIP_LONG_ONE_IN == 0) ? RRPV_MAX - 1 : RRPV_MAX);
+        break;
+    default:
+        repl_touch(cache, set, way);
+        break;
+    }
+}
+
+unsigned int repl_victim(cache_t *cache, cache_set_t *set) {
+    unsigned int way = 0;
+    switch (cache->policy) {
+    case REPL_LRU:
+        for (unsigned int i = 1; i < cache->E; i++) {
+            if (set->repl[i] < set->repl[way])
+                way = i;
+        }
+        break;
+    case REPL_PLRU:
+        way = plru_victim(set, cache->E);
+        break;
+    case REPL_SRRIP:
+    case REPL_BRRIP: {
+        /* Age every way by as much as it takes for one to be distant */
+        unsigned int max = 0;
+        for (unsigned int i = 0; i < cache->E; i++) {
+            unsigned int rrpv = get_rrpv(set, i);
+            if (rrpv > max) {
+                max = rrpv;
+                way = i;
+                if (max == RRPV_MAX)
+                    break;
+            }
+        }
+        if (max < RRPV_MAX) {
+            for (unsigned int i = 0; i < cache->E; i++)
+                put_rrpv(set, i, get_rrpv(set, i) + RRPV_MAX - max);
+        }
+        break;
+    }
+    case REPL_FIFO:
+        way = set->repl[0];
+        set->repl[0] = (way + 1) % cache->E;
+        break;
+    case REPL_RANDOM:
+        way = repl_rand(cache) % cache->E;
+        break;
+    }
+    return way;
+}
+
+/* What display_set shows for a way: its LRU stamp or RRPV, or for the
+ * other policies, whether it is the next victim.
+ */
+uword_t repl_state(const cache_t *cache, const cache_set_t *set, unsigned int way) {
+    switch (cache->policy) {
+    case REPL_LRU:
+        return set->repl[way];
+    case REPL_PLRU:
+        return plru_victim(set, cache->E) == way;
+    case REPL_SRRIP:
+    case REPL_BRRIP:
+        return get_rrpv(set, way);
+    case REPL_FIFO:
+        return set->repl[0] == way;
+    default:
+        return 0;
+    }
+}
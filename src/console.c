@@ -0,0 +1,133 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * console.c - Module for the guest console output device at IO_CHAR_ADDR.
+ *
+ * Guest output is formatted into a large buffer and handed to stdout when
+ * the buffer fills, before each debug trace, and at exit, producing the same
+ * bytes as when each store went straight to stdio. The LOG_OUTPUT echo of
+ * 8-byte stores stays unbuffered, like all logging, and can be turned off.
+ *
+ * Guest input is read from stdin, or the file given with -I, through a
+ * large buffer and parsed by hand, with the same results as the scanf()
+ * formats used before. Whitespace after a value is skipped just before the
+ * next read rather than right after it, so reads never block waiting for
+ * input they do not need.
+ **************************************************************************/
+
+#include <signal.h>
+#include <fcntl.h>
+#include "archsim.h"
+#include "console.h"
+
+bool console_echo = true;
+
+static char out_buf[CONSOLE_BUFSIZE];
+static size_t out_len;
+
+static int in_fd = STDIN_FILENO;
+static char in_buf[CONSOLE_BUFSIZE];
+static size_t in_pos, in_len;
+static bool in_skip_ws;
+
+void console_flush(void) {
+    if (out_len > 0) {
+        fwrite(out_buf, 1, out_len, stdout);
+        out_len = 0;
+    }
+}
+
+static void console_abort(int sig) {
+    console_flush(); // abort() then terminates with the default action.
+}
+
+// Make sure buffered output still comes out on exit() and on a failed assert.
+void console_init(void) {
+    atexit(console_flush);
+    signal(SIGABRT, console_abort);
+}
+
+void console_write(const uint64_t data, const unsigned width) {
+    // A single store never formats more than BUF_LEN bytes.
+    if (out_len + BUF_LEN > CONSOLE_BUFSIZE)
+        console_flush();
+
+    char *out = out_buf + out_len;
+    switch (width) {
+        case 1: out_buf[out_len++] = data & 0xFFU; break;
+        case 2: out_len += sprintf(out, "%hd %0#4hx\n", (short) (data & 0xFFFFU), (short) (data & 0xFFFFU)); break;
+        case 4: out_len += sprintf(out, "%d %0#8x\n", (int) (data & 0xFFFFFFFFU), (int) (data & 0xFFFFFFFFU)); break;
+        case 8: 
+            out_len += sprintf(out, "%ld %0#16lx\n", (long) data, (long) data);
+            if (console_echo) {
+                char printbuf[BUF_LEN];
+                sprintf(printbuf, "%ld %0#16lx", (long) data, (long) data);
+                logging(LOG_OUTPUT, printbuf);
+            }
+            break;
+        default: assert(false); break;
+    }
+}
+
+// Read guest input from fileName instead of stdin.
+bool console_input(const char *fileName) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+    in_fd = fd;
+    in_pos = in_len = 0;
+    return true;
+}
+
+// Return the next input character without consuming it, or EOF.
+static int in_peek(void) {
+    if (in_pos == in_len) {
+        ssize_t n = read(in_fd, in_buf, CONSOLE_BUFSIZE);
+        if (n <= 0) return EOF;
+        in_pos = 0;
+        in_len = n;
+    }
+    return (unsigned char) in_buf[in_pos];
+}
+
+static void in_skip_space(void) {
+    int c;
+    while (EOF != (c = in_peek()) && isspace(c))
+        in_pos++;
+}
+
+// Parse an optionally signed decimal integer, as scanf's %d does.
+static int64_t in_int(void) {
+    bool neg = false;
+    uint64_t val = 0;
+    int c = in_peek();
+    if ('-' == c || '+' == c) {
+        neg = ('-' == c);
+        in_pos++;
+        c = in_peek();
+    }
+    while (EOF != c && isdigit(c)) {
+        val = val*10 + (c - '0');
+        in_pos++;
+        c = in_peek();
+    }
+    return neg ? -val : val;
+}
+
+uint64_t console_read(const unsigned width) {
+    if (in_skip_ws) in_skip_space();
+    in_skip_ws = true;
+    if (1 != width) in_skip_space();
+
+    int c;
+    switch (width) {
+        case 1: 
+            c = in_peek();
+            if (EOF == c) return 0;
+            in_pos++;
+            return (char) (c & 0xFFU);
+        case 2: return (short) (in_int() & 0xFFFFU);
+        case 4: return (int) (in_int() & 0xFFFFFFFFU);
+        case 8: return (long) in_int();
+        default: assert(false); return 0;
+    }
+}
@@ -15,9 +15,14 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <string.h>
 #include <elf.h>
 #include "err_handler.h"
 #include "mem.h"
+#include "elf_loader.h"
+
+// The loaded file stays mapped so that its symbol table can be searched.
+static Elf64_Ehdr *elf_header;
 
 uint64_t loadElf(const char *fileName) {
     logging(LOG_INFO, "Loading ELF executable");
@@ -46,6 +51,7 @@ uint64_t loadElf(const char *fileName) {
     // Get ELF header information.
     Elf64_Ehdr *header = (Elf64_Ehdr *) ptr;
     assert(header->e_type == ET_EXEC); // Check that it's an executable.
+    elf_header = header;
     uint64_t entry = header->e_entry; // Entry point of ELF executable.
     uint64_t entry_size = header->e_phentsize;
     uint64_t entry_count = header->e_phnum;
@@ -57,16 +63,40 @@ uint64_t loadElf(const char *fileName) {
             uint8_t *dataPtr = (uint8_t *)(ptr + progHeader->p_offset);
             uint64_t vaddr = progHeader->p_vaddr;
             uint64_t filesz = progHeader->p_filesz;
-            // uint64_t memsz = progHeader->p_memsz;
+            uint64_t memsz = progHeader->p_memsz;
             // printf("%lx %lx %lx\n",vaddr, filesz, memsz);
-            for (uint64_t j = 0; j < filesz; j++) {
-                uint64_t addr = vaddr + j;
-                uint8_t byte = dataPtr[j];
-                _mem_write(addr, (uint64_t) byte, 1);
-            }            
+            mem_load(vaddr, dataPtr, filesz, memsz);
         }
         progHeader = (Elf64_Phdr *) (((uintptr_t) progHeader) + entry_size);
     }
 
     return entry;
 }
+
+/*
+ * Look up the address of a symbol in the symbol table of the loaded
+ * executable. Returns false if there is no such symbol, or the executable
+ * has been stripped.
+ */
+
+bool lookupSymbol(const char *name, uint64_t *addr) {
+    if (elf_header == NULL || elf_header->e_shoff == 0)
+        return false;
+    uintptr_t ptr = (uintptr_t) elf_header;
+    Elf64_Shdr *sections = (Elf64_Shdr *)(ptr + elf_header->e_shoff);
+    for (unsigned i = 0; i < elf_header->e_shnum; i++) {
+        if (sections[i].sh_type != SHT_SYMTAB)
+            continue;
+        Elf64_Sym *syms = (Elf64_Sym *)(ptr + sections[i].sh_offset);
+        const char *strtab = (const char *)(ptr + sections[sections[i].sh_link].sh_offset);
+        uint64_t num_syms = sections[i].sh_size / sizeof(Elf64_Sym);
+        for (uint64_t j = 0; j < num_syms; j++) {
+            if (syms[j].st_name != 0 && syms[j].st_shndx != SHN_UNDEF &&
+                strcmp(strtab + syms[j].st_name, name) == 0) {
+                *addr = syms[j].st_value;
+                return true;
+            }
+        }
+    }
+    return false;
+}
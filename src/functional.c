@@ -0,0 +1,79 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * functional.c - A functional model of the processor that retires one
+ * instruction per step with no pipeline timing. It is used to run quickly
+ * through the start of a program before the pipeline takes over.
+ *
+ * Each step reuses the datapath elements of the pipeline (regfile, alu,
+ * dmem) and the decoded instructions in the predecode cache, so both
+ * models compute the same architectural state.
+ **************************************************************************/
+
+#include "archsim.h"
+#include "hw_elts.h"
+#include "predecode.h"
+#include "jit.h"
+#include "sample.h"
+
+extern machine_t guest;
+
+/*
+ * Run the guest functionally from the current architectural PC until
+ * max_instr instructions have retired (0 for no limit), the PC reaches
+ * stop_PC (0 for none), or main returns. Returns true if main returned.
+ */
+
+bool runFunctional(const uint64_t max_instr, const uint64_t stop_PC, uint64_t *num_instr) {
+    uint64_t PC = guest.proc->PC.bits->xval;
+    *num_instr = 0;
+
+    while (!(max_instr && *num_instr >= max_instr) && !(stop_PC && PC == stop_PC)) {
+        if (use_jit && bbv_file == NULL) {
+            jit_run(&PC, max_instr ? max_instr - *num_instr : 0, stop_PC, num_instr);
+            if ((max_instr && *num_instr >= max_instr) || (stop_PC && PC == stop_PC))
+                break;
+        }
+
+        predecode_ptr_t pd = predecode_at(PC);
+        uint64_t val_a, val_b, val_ex, val_mem = 0, unused;
+        bool condval, dmem_err;
+
+        regfile(pd->pd_src1, pd->pd_src2, 0, 0,
+                pd->pd_D_sigs.src1_31isSP, pd->pd_D_sigs.src2_31isSP, false, false,
+                &val_a, &val_b);
+
+        if (pd->pd_op == OP_HLT ||
+            (pd->pd_op == OP_RET && val_a == RET_FROM_MAIN_ADDR)) {
+            guest.proc->PC.bits->xval = PC;
+            return true;
+        }
+
+        alu(val_a, pd->pd_X_sigs.valb_sel ? pd->pd_imm : val_b, pd->pd_hw,
+            pd->pd_ALU_op, pd->pd_X_sigs.set_CC, pd->pd_cond, &val_ex, &condval);
+
+        if (pd->pd_M_sigs.dmem_read || pd->pd_M_sigs.dmem_write) {
+            dmem_complete(val_ex, val_b, pd->pd_M_sigs.dmem_read, pd->pd_M_sigs.dmem_write,
+                          &val_mem, &dmem_err);
+        }
+
+        uint64_t wval = pd->pd_W_sigs.wval_sel ? val_mem : val_ex;
+        if (pd->pd_W_sigs.dst_sel)
+            wval = PC + 4;
+        regfile(0, 0, pd->pd_dst, wval,
+                false, false, pd->pd_W_sigs.dst_31isSP, pd->pd_W_sigs.w_enable,
+                &unused, &unused);
+
+        if (pd->pd_op == OP_RET)
+            PC = val_a;
+        else if (pd->pd_op == OP_B_COND)
+            PC = condval ? pd->pd_target : PC + 4;
+        else
+            PC = pd->pd_target;
+        (*num_instr)++;
+        if (bbv_file != NULL)
+            bbv_retire(pd->pd_PC, pd->pd_op);
+    }
+    guest.proc->PC.bits->xval = PC;
+    return false;
+}
@@ -11,6 +11,11 @@
 
 #include <unistd.h>
 #include "archsim.h"
+#include "console.h"
+#include "sample.h"
+#include "trace.h"
+#include "bpred.h"
+#include "hier.h"
 
 static char printbuf[BUF_LEN];
 
@@ -22,11 +27,19 @@ void handle_args(int argc, char **argv) {
     outfile = stdout;
     errfile = stderr;
 
-    while ((option = getopt(argc, argv, "i:o:v:s:b:E:d:")) != -1) {
+    while ((option = getopt(argc, argv, "i:I:o:v:T:qc:n:x:P:s:b:E:d:R:L:C:Ff:p:JS:W:U:B:")) != -1) {
         switch(option) {
             case 'i':
                 infile_name = optarg;
                 break;
+            case 'I':
+                if (!console_input(optarg)) {
+                    assert(strlen(optarg) < BUF_LEN);
+                    sprintf(printbuf, "failed to open input file %s", optarg);
+                    logging(LOG_FATAL, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case 'o':
                 if ((outfile = fopen(optarg, "w")) == NULL) {
                     assert(strlen(optarg) < BUF_LEN);
@@ -57,7 +70,68 @@ void handle_args(int argc, char **argv) {
 
                 sprintf(printbuf, "Logging at level %d", debug_level);
                 logging(LOG_INFO, printbuf);
-                
+#ifdef TRACE
+                trace_on = trace_on || debug_level > 0;
+#else
+                logging(LOG_INFO, "Tracing is not compiled in, ignoring -v");
+#endif
+                break;
+            case 'T':
+#ifdef TRACE
+                if (!trace_open(optarg)) {
+                    assert(strlen(optarg) < BUF_LEN);
+                    sprintf(printbuf, "failed to open trace file %s", optarg);
+                    logging(LOG_FATAL, printbuf);
+                    exit(EXIT_FAILURE);
+                }
+#else
+                logging(LOG_INFO, "Tracing is not compiled in, ignoring -T");
+#endif
+                break;
+            case 'q':
+                console_echo = false; break;
+            case 'c':
+                max_cycles = strtoull(optarg, NULL, 0); break;
+            case 'n':
+                max_retired = strtoull(optarg, NULL, 0); break;
+            case 'x': {
+                // An address, or else the name of a symbol to stop at.
+                char *end;
+                stop_PC = strtoull(optarg, &end, 0);
+                stop_symbol = (*end != '\0') ? optarg : NULL;
+                break;
+            }
+            case 'P':
+                if (!bpred_configure(optarg)) {
+                    logging(LOG_FATAL, "bad -P, use <taken|bimodal|gshare|tage>[:bits][,btb:bits]");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'F':
+                functional_only = true; break;
+            case 'f':
+                ff_instr = strtoull(optarg, NULL, 0); break;
+            case 'p':
+                ff_PC = strtoull(optarg, NULL, 0); break;
+            case 'J':
+                use_jit = false; break;
+            case 'S':
+                sample_period = strtoull(optarg, NULL, 0); break;
+            case 'W':
+                sample_warm = strtoull(optarg, NULL, 0); break;
+            case 'U':
+                if ((sample_unit = strtoull(optarg, NULL, 0)) == 0) {
+                    logging(LOG_FATAL, "sample unit size must be positive");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'B':
+                if ((bbv_file = fopen(optarg, "w")) == NULL) {
+                    assert(strlen(optarg) < BUF_LEN);
+                    sprintf(printbuf, "failed to open BBV file %s", optarg);
+                    logging(LOG_FATAL, printbuf);
+                    exit(EXIT_FAILURE);
+                }
                 break;
 #ifdef CACHE
             case 's':
@@ -68,6 +142,24 @@ void handle_args(int argc, char **argv) {
                 E = atoi(optarg); break;
             case 'd':
                 d = atoi(optarg); break;
+            case 'R':
+                if (!repl_parse(optarg, &repl_policy)) {
+                    logging(LOG_FATAL, "bad -R, use lru, plru, srrip, brrip, fifo or random");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'L':
+                if (!hier_configure(optarg)) {
+                    logging(LOG_FATAL, "bad -L, use s:E:d[:inclusive|nine|exclusive], at most twice");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'C':
+                if (!hier_configure_l1i(optarg)) {
+                    logging(LOG_FATAL, "bad -C, use s:E");
+                    exit(EXIT_FAILURE);
+                }
+                break;
 #endif
             default:
                 sprintf(printbuf, "Ignoring unknown option %c", optopt);
@@ -80,6 +172,10 @@ void handle_args(int argc, char **argv) {
         sprintf(printbuf, "Ignoring extra argument %s", argv[optind]);
         logging(LOG_INFO, printbuf);
     }
+    if (bbv_file != NULL && sample_period == 0) {
+        logging(LOG_FATAL, "BBV output needs a sampling period (-S)");
+        exit(EXIT_FAILURE);
+    }
 //    if (infile == NULL) infile = stdin;
     return;
 }
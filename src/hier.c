@@ -0,0 +1,274 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * hier.c - The cache hierarchy below the L1D and L1I. mem.c asks for the
+ * latency of an L1 miss when it starts, and for the fill when it
+ * completes. The fill walks down the levels until one holds the block,
+ * filling the levels on the way back up as their inclusion policies say,
+ * and writes the blocks they evict further down.
+ **************************************************************************/
+
+#include <errno.h>
+#include <limits.h>
+#include "archsim.h"
+#include "hier.h"
+
+static char printbuf[BUF_LEN];
+
+static cache_level_t levels[HIER_MAX_LEVELS] = {
+    {.name = "L1D"}, {.name = "L2"}, {.name = "L3"}
+};
+static cache_level_t l1i = {.name = "L1I"}; // Beside the L1D, over the L2.
+static unsigned nlevels = 1;
+static unsigned block_bits;
+static unsigned mem_latency;
+static byte_t *fill_buf; // The block on its way up to the L1D.
+
+static const char *incl_names[] = {
+    [INCL_INCLUSIVE] = "inclusive",
+    [INCL_NINE] = "nine",
+    [INCL_EXCLUSIVE] = "exclusive",
+};
+
+/* Parse the unsigned number at spec, leaving *end after it. False if
+ * there is none, or it does not fit.
+ */
+static bool parse_unsigned(const char *spec, char **end, unsigned *v) {
+    errno = 0;
+    unsigned long n = strtoul(spec, end, 0);
+    if (*end == spec || errno != 0 || n > UINT_MAX)
+        return false;
+    *v = n;
+    return true;
+}
+
+/* Add the next lower level from a -L option, s:E:d[:inclusion], where the
+ * inclusion policy is inclusive (the default), nine or exclusive.
+ */
+bool hier_configure(const char *spec) {
+    if (nlevels == HIER_MAX_LEVELS)
+        return false;
+    cache_level_t *lv = &levels[nlevels];
+    char *end;
+    unsigned v[3];
+    for (int i = 0; i < 3; i++) {
+        if (!parse_unsigned(spec, &end, &v[i]) ||
+            (*end != ':' && *end != '\0') || (i < 2 && *end != ':'))
+            return false;
+        spec = end + 1;
+    }
+    lv->s = v[0];
+    lv->E = v[1];
+    lv->d = v[2];
+    lv->incl = INCL_INCLUSIVE;
+    if (*end == ':') {
+        int i;
+        for (i = INCL_INCLUSIVE; i <= INCL_EXCLUSIVE; i++) {
+            if (strcmp(spec, incl_names[i]) == 0)
+                break;
+        }
+        if (i > INCL_EXCLUSIVE)
+            return false;
+        lv->incl = i;
+    }
+    if (lv->E == 0 || lv->s > HIER_MAX_BITS)
+        return false;
+    nlevels++;
+    return true;
+}
+
+/* Add an L1I from a -C option, s:E. */
+bool hier_configure_l1i(const char *spec) {
+    char *end;
+    if (!parse_unsigned(spec, &end, &l1i.s) || *end != ':')
+        return false;
+    spec = end + 1;
+    if (!parse_unsigned(spec, &end, &l1i.E) || *end != '\0' || l1i.E == 0 || l1i.s > HIER_MAX_BITS)
+        return false;
+    l1i.cache = (cache_t *) -1; // Created by hier_init().
+    return true;
+}
+
+/* Every level indexes sets and blocks with int shifts in cache.c. */
+static void check_size(const cache_level_t *lv, const unsigned b) {
+    if (lv->s > HIER_MAX_BITS || b > HIER_MAX_BITS - lv->s) {
+        sprintf(printbuf, "%s too large: s + b must be at most %d", lv->name, HIER_MAX_BITS);
+        logging(LOG_FATAL, printbuf);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Build the hierarchy, and return the L1D.
+cache_t *hier_init(const unsigned s, const unsigned b, const unsigned E, const unsigned d) {
+    block_bits = b;
+    mem_latency = d;
+    levels[0].s = s;
+    levels[0].E = E;
+    levels[0].d = 0; // L1D hits are hidden in the pipeline.
+    for (unsigned k = 0; k < nlevels; k++) {
+        check_size(&levels[k], b);
+        levels[k].cache = create_cache(levels[k].s, b, levels[k].E, levels[k].d);
+    }
+    if (l1i.cache != NULL) {
+        check_size(&l1i, b);
+        l1i.cache = create_cache(l1i.s, b, l1i.E, 0);
+    }
+    fill_buf = calloc(1, 1 << b);
+    return levels[0].cache;
+}
+
+// The L1I, or NULL if there is none.
+cache_t *hier_l1i(void) {
+    return l1i.cache;
+}
+
+static cache_level_t *top_level(const hier_top_t top) {
+    return (top == HIER_L1I) ? &l1i : &levels[0];
+}
+
+/* Cycles until an L1 miss on addr completes, at least 1, and the level
+ * that supplies the block. Nothing is changed.
+ */
+uint64_t hier_latency(const hier_top_t top, const uint64_t addr, perf_cause_t *cause) {
+    uint64_t latency = 0;
+    for (unsigned k = 1; k < nlevels; k++) {
+        latency += levels[k].d;
+        if (get_line(levels[k].cache, addr) != NULL) {
+            *cause = CPI_L2 + (k - 1);
+            return latency ? latency : 1;
+        }
+    }
+    *cause = CPI_MEM;
+    latency += mem_latency;
+    return latency ? latency : 1;
+}
+
+static void write_block(const unsigned k, const uint64_t addr, byte_t *data, const bool dirty);
+
+/* An inclusive level k is evicting the block at addr, whose data is in
+ * data: drop it from every level above. A dirty copy above is newer, so
+ * it replaces data. Returns whether the block is dirty anywhere.
+ */
+static bool back_invalidate(const unsigned k, const uint64_t addr, byte_t *data, bool dirty) {
+    for (unsigned j = 0; j <= k; j++) {
+        cache_level_t *above = (j == k) ? &l1i : &levels[j];
+        if (above->cache == NULL)
+            continue;
+        cache_line_t *line = get_line(above->cache, addr);
+        if (line == NULL)
+            continue;
+        if (line->dirty) {
+            memcpy(data, line->data, 1 << block_bits);
+            dirty = true;
+        }
+        invalidate_line(above->cache, addr);
+        levels[k].back_invals++;
+    }
+    return dirty;
+}
+
+/* Put the block at addr into lv, which is level k (0 for either L1), and
+ * send its victim down.
+ */
+static void fill_level(cache_level_t *lv, const unsigned k, const uint64_t addr, byte_t *data, const bool dirty) {
+    evicted_line_t *evicted = handle_miss(lv->cache, addr, dirty ? WRITE : READ, data);
+    if (evicted->valid) {
+        bool victim_dirty = evicted->dirty;
+        if (k > 0 && lv->incl == INCL_INCLUSIVE)
+            victim_dirty = back_invalidate(k, evicted->addr, evicted->data, victim_dirty);
+        if (victim_dirty)
+            lv->writebacks++;
+        write_block(k + 1, evicted->addr, evicted->data, victim_dirty);
+    }
+}
+
+/* A block evicted from the level above arrives at level k. A level that
+ * holds it takes a dirty copy. Otherwise an exclusive level keeps it, and
+ * any other passes it on. Memory only takes dirty blocks.
+ */
+static void write_block(const unsigned k, const uint64_t addr, byte_t *data, const bool dirty) {
+    if (k == nlevels) {
+        if (dirty)
+            mem_write_block(addr, data, 1 << block_bits);
+        return;
+    }
+    cache_line_t *line = get_line(levels[k].cache, addr);
+    if (line != NULL) {
+        if (dirty) {
+            memcpy(line->data, data, 1 << block_bits);
+            line->dirty = true;
+        }
+    } else if (levels[k].incl == INCL_EXCLUSIVE) {
+        fill_level(&levels[k], k, addr, data, dirty);
+    } else {
+        write_block(k + 1, addr, data, dirty);
+    }
+}
+
+/* Fetch the block at addr from level k or below into data. Returns true
+ * if it comes up dirty, which only happens when it leaves an exclusive
+ * level.
+ */
+static bool read_block(const unsigned k, const uint64_t addr, byte_t *data) {
+    if (k == nlevels) {
+        mem_read_block(addr, data, 1 << block_bits);
+        return false;
+    }
+    cache_level_t *lv = &levels[k];
+    lv->accesses++;
+    if (check_hit(lv->cache, addr, READ)) {
+        cache_line_t *line = get_line(lv->cache, addr);
+        memcpy(data, line->data, 1 << block_bits);
+        if (lv->incl != INCL_EXCLUSIVE)
+            return false;
+        bool dirty = line->dirty;
+        invalidate_line(lv->cache, addr);
+        return dirty;
+    }
+    lv->misses++;
+    bool dirty = read_block(k + 1, addr, data);
+    if (lv->incl == INCL_EXCLUSIVE)
+        return dirty;
+    fill_level(lv, k, addr, data, dirty);
+    return false;
+}
+
+/* Complete an L1 miss on the block at addr, made by an op. The L1I only
+ * holds clean blocks, so that a load never misses a newer copy there; a
+ * dirty block it takes from an exclusive level goes to memory first.
+ */
+void hier_fill(const hier_top_t top, const uint64_t addr, const operation_t op) {
+    top_level(top)->misses++;
+    bool dirty = read_block(1, addr, fill_buf);
+    if (top == HIER_L1I && dirty) {
+        mem_write_block(addr, fill_buf, 1 << block_bits);
+        dirty = false;
+    }
+    fill_level(top_level(top), 0, addr, fill_buf, dirty || op == WRITE);
+}
+
+/* A load, store or fetch of width bytes at addr has completed in an L1.
+ * It counts once for each block it spans, as a miss does.
+ */
+void hier_count_access(const hier_top_t top, const uint64_t addr, const unsigned width) {
+    top_level(top)->accesses += ((addr + width - 1) >> block_bits) - (addr >> block_bits) + 1;
+}
+
+void hier_print_stats(FILE *f) {
+    if (levels[0].cache == NULL)
+        return;
+    fprintf(f, "Cache hierarchy: %u-byte blocks, %s replacement, memory latency %u\n",
+            1 << block_bits, repl_name(repl_policy), mem_latency);
+    for (int k = (l1i.cache != NULL) ? -1 : 0; k < (int) nlevels; k++) {
+        cache_level_t *lv = (k < 0) ? &l1i : &levels[k];
+        sprintf(printbuf, "  %-4s s=%u E=%u", lv->name, lv->s, lv->E);
+        if (k > 0)
+            sprintf(printbuf + strlen(printbuf), " d=%u %s", lv->d, incl_names[lv->incl]);
+        fprintf(f, "%-32s accesses %lu, misses %lu (%.2f%%), writebacks %lu",
+                printbuf, lv->accesses, lv->misses,
+                lv->accesses ? 100.0 * lv->misses / lv->accesses : 0.0, lv->writebacks);
+        if (k > 0 && lv->incl == INCL_INCLUSIVE)
+            fprintf(f, ", back-invalidations %lu", lv->back_invals);
+        fprintf(f, "\n");
+    }
+}
@@ -6,12 +6,13 @@
 #include "err_handler.h"
 
 extern machine_t guest;
+extern mem_status_t dmem_status;
 
 comb_logic_t 
 imem(uint64_t imem_addr,
      uint32_t *imem_rval, bool *imem_err) {
     *imem_err = (imem_addr & 0x3U) ? true : false;
-    *imem_rval = (uint32_t) mem_read_I(imem_addr);
+    *imem_rval = mem_read_insn(imem_addr);
 }
 
 comb_logic_t
@@ -119,4 +120,16 @@ dmem(uint64_t dmem_addr, uint64_t dmem_wval, bool dmem_read, bool dmem_write, ui
     dmem_err = false; // FIX LATER
     if (dmem_read) *dmem_rval = (uint64_t) mem_read_L(dmem_addr);
     if (dmem_write) mem_write_L(dmem_addr, dmem_wval);
+}
+
+/* dmem() for the models with no pipeline to stall. A cache miss completes
+ * once its latency has passed, so skip straight to that cycle.
+ */
+comb_logic_t
+dmem_complete(uint64_t dmem_addr, uint64_t dmem_wval, bool dmem_read, bool dmem_write, uint64_t *dmem_rval, bool *dmem_err) {
+    dmem(dmem_addr, dmem_wval, dmem_read, dmem_write, dmem_rval, dmem_err);
+    while (dmem_status == IN_FLIGHT) {
+        mem_skip_inflight(mem_inflight_cycles() - 1);
+        dmem(dmem_addr, dmem_wval, dmem_read, dmem_write, dmem_rval, dmem_err);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,515 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * instr.c - The five pipeline stages and their helper logic.
+ *
+ * Each stage reads its pipeline register's input side and writes the
+ * output side; proc.c moves outputs to the next stage's inputs.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include "archsim.h"
+#include "hw_elts.h"
+#include "instr.h"
+#include "machine.h"
+#include "predecode.h"
+#include "bpred.h"
+#include "pipe/forward.h"
+
+extern machine_t guest;
+extern uint64_t pred_pc;
+extern uint64_t current_PC;
+extern mem_status_t imem_status;
+
+bool X_condval;
+static uint64_t W_wval;
+
+unsigned
+safe_GETBF(int32_t src, unsigned frompos, unsigned width) {
+    return ((src & (((1U << width) - 1) << frompos)) >> frompos);
+}
+
+static int64_t
+safe_GETBOFFSET(int32_t src, unsigned frompos, unsigned width) {
+    int64_t x = (int64_t) (src & (((1 << width) - 1) << frompos));
+    x = (int64_t) ((uint64_t) x >> frompos << (64 - width));
+    return x >> (64 - width);
+}
+
+static inline void init_itable_entry(opcode_t op, unsigned idx) { itable[idx] = op; }
+
+static inline void init_itable_range(opcode_t op, unsigned idx1, unsigned idx2) {
+    for (unsigned i = idx1; i <= idx2; i++) itable[i] = op;
+}
+
+/*
+ * Fill the instruction table, which maps the top 11 bits of an instruction
+ * to its opcode. Encodings not listed here decode as OP_ERROR.
+ */
+
+void init_itable(void) {
+    for (int i = 0; i < (1 << 12); i++) itable[i] = OP_ERROR;
+    init_itable_entry(OP_LDURB,   0x1c2U);
+    init_itable_entry(OP_LDUR,    0x7c2U);
+    init_itable_entry(OP_STURB,   0x1c0U);
+    init_itable_entry(OP_STUR,    0x7c0U);
+    init_itable_range(OP_MOVK,    0x794U, 0x797U);
+    init_itable_range(OP_MOVZ,    0x694U, 0x697U);
+    init_itable_range(OP_ADD_RI,  0x488U, 0x48bU);
+    init_itable_entry(OP_ADDS_RR, 0x558U);
+    init_itable_entry(OP_SUBS_RR, 0x758U);
+    init_itable_entry(OP_MVN,     0x551U);
+    init_itable_entry(OP_ORR_RR,  0x550U);
+    init_itable_entry(OP_EOR_RR,  0x650U);
+    init_itable_entry(OP_ANDS_RR, 0x750U);
+    init_itable_range(OP_UBFM,    0x69aU, 0x69bU);
+    init_itable_range(OP_ASR,     0x49aU, 0x49bU);
+    init_itable_range(OP_B,       0x0a0U, 0x0bfU);
+    init_itable_range(OP_B_COND,  0x2a0U, 0x2a7U);
+    init_itable_range(OP_BL,      0x4a0U, 0x4bfU);
+    init_itable_entry(OP_RET,     0x6b2U);
+    init_itable_entry(OP_NOP,     0x6a8U);
+    init_itable_entry(OP_HLT,     0x6a2U);
+    return;
+}
+
+/*
+ * Select PC logic.
+ * A conditional branch in X that went the other way from F's prediction
+ * restarts fetch on the path it took, and a B or BL that missed in the
+ * BTB restarts it at the target, and a RET that the RAS got wrong
+ * restarts it at the return address. Otherwise fetch continues from the
+ * predicted PC.
+ */
+
+static comb_logic_t
+select_PC(uint64_t pred_PC,                                     // The predicted PC
+          opcode_t X_opcode, bool X_cond_val, bool X_pred_taken, // Possible correction from X
+          uint64_t seq_succ, uint64_t target,
+          opcode_t D_opcode, uint64_t val_a,                     // Possible correction from D
+          uint64_t *current_PC) {                                // Output
+    if (X_opcode == OP_B_COND && X_cond_val != X_pred_taken)
+        *current_PC = X_cond_val ? target : seq_succ;
+    else if ((X_opcode == OP_B || X_opcode == OP_BL) && !X_pred_taken)
+        *current_PC = target;
+    else if (D_opcode == OP_RET && !(X_pred_taken && target == val_a))
+        *current_PC = val_a;
+    else
+        *current_PC = pred_PC;
+    return;
+}
+
+/*
+ * Predict PC logic. Branches go to their target; predict_branch() then
+ * decides whether fetch follows it.
+ */
+
+static comb_logic_t
+predict_PC(uint64_t current_PC, uint32_t insnbits, opcode_t op,
+           uint64_t *predicted_PC, uint64_t *seq_succ) {
+    *seq_succ = current_PC + 4;
+    if (op != OP_B && op != OP_B_COND && op != OP_BL) {
+        *predicted_PC = *seq_succ;
+        return;
+    }
+    int64_t offset = (op == OP_B_COND) ? safe_GETBOFFSET(insnbits, 5, 19) : safe_GETBOFFSET(insnbits, 0, 26);
+    offset <<= 2;
+    *predicted_PC = current_PC + offset;
+}
+
+/*
+ * Global history after an instruction, assuming fetch followed it.
+ */
+
+static inline uint64_t
+hist_after(const instr_impl_t *insn) {
+    return (insn->op == OP_B_COND) ? (insn->pred_hist << 1) | insn->pred_taken : insn->pred_hist;
+}
+
+/*
+ * The instruction whose prediction state the instruction being fetched
+ * continues from: the youngest older one still in D or X. Everything
+ * older has retired, so NULL means the committed state applies. If X has
+ * just found a mispredict, D is on the wrong path and X is returned with
+ * *mispred set. Bubbles have no successor PC.
+ */
+
+static const instr_impl_t *
+fetch_predecessor(bool *mispred) {
+    const instr_impl_t *X = guest.proc->x_insn->in, *D = guest.proc->d_insn->in;
+    *mispred = X->op == OP_B_COND && X->seq_succ_PC != 0 && X_condval != X->pred_taken;
+    if (*mispred)
+        return X;
+    if (D->seq_succ_PC != 0)
+        return D;
+    if (X->seq_succ_PC != 0)
+        return X;
+    return NULL;
+}
+
+/*
+ * Predict whether fetch follows a branch to its target. The direction of
+ * a B.cond comes from the predictor, and a taken branch also needs a BTB
+ * hit, or fetch falls through and X corrects it. BL pushes its return
+ * address on the RAS, and RET pops its target from it; with the RAS
+ * empty, fetch falls through and D corrects it.
+ */
+
+static comb_logic_t
+predict_branch(uint64_t current_PC, uint64_t target, instr_impl_t *out, uint64_t *predicted_PC) {
+    bool mispred;
+    const instr_impl_t *prev = fetch_predecessor(&mispred);
+    if (prev == NULL) {
+        out->pred_hist = bpred_history();
+        ras_committed(&out->ras_tos, &out->ras_count);
+    } else {
+        out->pred_hist = mispred ? (prev->pred_hist << 1) | X_condval : hist_after(prev);
+        out->ras_tos = prev->ras_tos;
+        out->ras_count = prev->ras_count;
+    }
+    if (mispred)
+        ras_recover();
+
+    out->target_PC = target;
+    out->pred_dir = false;
+    out->pred_taken = false;
+    if (out->op == OP_RET) {
+        out->pred_taken = ras_pop(&out->ras_tos, &out->ras_count, &out->target_PC);
+        if (out->pred_taken)
+            *predicted_PC = out->target_PC;
+        return;
+    }
+    if (out->op != OP_B && out->op != OP_B_COND && out->op != OP_BL)
+        return;
+
+    if (out->op == OP_BL)
+        ras_push(&out->ras_tos, &out->ras_count, out->seq_succ_PC);
+    out->pred_dir = (out->op != OP_B_COND) || bpred_direction(current_PC, out->pred_hist);
+    out->pred_taken = out->pred_dir && btb_lookup(current_PC);
+    if (!out->pred_taken)
+        *predicted_PC = out->seq_succ_PC;
+}
+
+/*
+ * Helper function to generate the control signals for the D, X, M and W
+ * stages from the opcode.
+ */
+
+static void
+generate_DXMW_control(opcode_t op,
+                      d_ctl_sigs_t *D_sigs, x_ctl_sigs_t *X_sigs, m_ctl_sigs_t *M_sigs, w_ctl_sigs_t *W_sigs) {
+    D_sigs->src2_sel = op != OP_STUR;
+    D_sigs->src1_31isSP = (op == OP_LDUR || op == OP_STUR || op == OP_ADD_RI);
+    D_sigs->src2_31isSP = false;
+
+    // The immediate is the second ALU operand for every non-RR computation.
+    X_sigs->valb_sel = op <= OP_ASR && (op <= OP_ADD_RI || op > OP_ANDS_RR);
+    X_sigs->set_CC = (op == OP_ADDS_RR || op == OP_SUBS_RR || op == OP_ANDS_RR);
+
+    M_sigs->dmem_read = op == OP_LDUR;
+    M_sigs->dmem_write = op == OP_STUR;
+
+    W_sigs->dst_sel = op == OP_BL;
+    W_sigs->wval_sel = op == OP_LDUR;
+    W_sigs->w_enable = (op == OP_LDUR || (op > OP_STUR && op <= OP_ASR) || op == OP_BL);
+    W_sigs->dst_31isSP = false;
+}
+
+/*
+ * Helper function to extract the immediate operand, if any, from the
+ * instruction bits. Returns false if the instruction has none.
+ */
+
+static bool
+extract_immval(uint32_t insnbits, opcode_t op, int64_t *imm) {
+    switch (op) {
+        case OP_LDUR: case OP_STUR:
+            *imm = safe_GETBOFFSET(insnbits, 12, 9);
+            return true;
+        case OP_MOVK: case OP_MOVZ:
+            *imm = safe_GETBF(insnbits, 5, 16);
+            return true;
+        case OP_ADD_RI: case OP_ASR:
+            *imm = safe_GETBOFFSET(insnbits, 10, 12);
+            return true;
+        case OP_LSL:
+            *imm = 64 - safe_GETBF(insnbits, 16, 6);
+            return true;
+        case OP_LSR:
+            *imm = safe_GETBF(insnbits, 16, 6);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Helper function to decide which ALU operation the X stage performs.
+ */
+
+static void
+decide_alu_op(opcode_t op, alu_op_t *ALU_op) {
+    alu_op_t res;
+    switch (op) {
+        case OP_NONE:
+            assert(false);
+        case OP_LDURB:
+        case OP_LDUR:
+        case OP_STURB:
+        case OP_STUR:
+            res = PLUS_OP; break;
+        case OP_MOVK:
+        case OP_MOVZ:
+            res = MOV_OP; break;
+        case OP_ADD_RI:
+        case OP_ADDS_RR:
+            res = PLUS_OP; break;
+        case OP_SUBS_RR:
+            res = MINUS_OP; break;
+        case OP_MVN:
+            res = NEG_OP; break;
+        case OP_ORR_RR:
+            res = OR_OP; break;
+        case OP_EOR_RR:
+            res = EOR_OP; break;
+        case OP_ANDS_RR:
+            res = AND_OP; break;
+        case OP_LSL:
+            res = LSL_OP; break;
+        case OP_LSR:
+            res = LSR_OP; break;
+        case OP_UBFM:
+            assert(false); // Fetch resolves UBFM to LSL or LSR.
+        case OP_ASR:
+            res = ASR_OP; break;
+        case OP_B:
+        case OP_B_COND:
+        case OP_BL:
+        case OP_RET:
+        case OP_NOP:
+        case OP_HLT:
+            res = PASS_A_OP; break;
+        default:
+            assert(false);
+    }
+    *ALU_op = res;
+}
+
+/*
+ * Utility functions to copy over control signals across a stage.
+ */
+
+static void
+copy_m_ctl_sigs(pipe_reg_t *const insn) {
+    insn->out->M_sigs.dmem_read = insn->in->M_sigs.dmem_read;
+    insn->out->M_sigs.dmem_write = insn->in->M_sigs.dmem_write;
+}
+
+static void
+copy_w_ctl_sigs(pipe_reg_t *const insn) {
+    insn->out->W_sigs.dst_sel = insn->in->W_sigs.dst_sel;
+    insn->out->W_sigs.wval_sel = insn->in->W_sigs.wval_sel;
+    insn->out->W_sigs.w_enable = insn->in->W_sigs.w_enable;
+    insn->out->W_sigs.dst_31isSP = insn->in->W_sigs.dst_31isSP;
+}
+
+/*
+ * Helper function to decode everything that depends only on the
+ * instruction bits into a predecode entry.
+ */
+
+static void
+predecode_instr(uint32_t insnbits, opcode_t op, predecode_ptr_t pd) {
+    generate_DXMW_control(op, &pd->pd_D_sigs, &pd->pd_X_sigs, &pd->pd_M_sigs, &pd->pd_W_sigs);
+    pd->pd_src1 = (op == OP_MOVZ) ? 0x1F : GETBF(insnbits, 5, 5);
+    pd->pd_src2 = pd->pd_D_sigs.src2_sel ? GETBF(insnbits, 16, 5) : GETBF(insnbits, 0, 5);
+    pd->pd_has_imm = extract_immval(insnbits, op, &pd->pd_imm);
+    pd->pd_cond = GETBF(insnbits, 0, 4);
+    pd->pd_dst = pd->pd_W_sigs.dst_sel ? 30 : GETBF(insnbits, 0, 5);
+    pd->pd_hw = GETBF(insnbits, 21, 2) << 4;
+    decide_alu_op(op, &pd->pd_ALU_op);
+    pd->pd_decoded = true;
+}
+
+/*
+ * Helper function to look up the predecode entry for PC, reading the
+ * instruction from memory and resolving its opcode on a miss.
+ */
+
+static predecode_ptr_t
+fetch_predecode(uint64_t PC) {
+    predecode_ptr_t pd = predecode_lookup(PC);
+    if (NULL != pd)
+        return pd;
+
+    bool imem_err;
+    uint32_t instr;
+    imem(PC, &instr, &imem_err);
+    opcode_t op = itable[GETBF(instr, 21, 11)];
+
+    if (op == OP_UBFM) {
+        // LSL and LSR are aliases of UBFM, told apart by imms and immr.
+        uint8_t imms = GETBF(instr, 10, 6);
+        uint8_t immr = GETBF(instr, 16, 6);
+        if ((imms & 0x3F) == 0x3F) op = OP_LSR;
+        else if (imms + 1 == immr) op = OP_LSL;
+        else assert(false);
+    }
+    pd = predecode_fill(PC, instr, op);
+
+    uint64_t seq_succ;
+    predict_PC(PC, instr, op, &pd->pd_target, &seq_succ);
+    return pd;
+}
+
+/*
+ * Fully decoded entry for the instruction at PC, for the functional
+ * model, which has no pipeline registers to carry it from F to D.
+ */
+
+predecode_ptr_t
+predecode_at(uint64_t PC) {
+    predecode_ptr_t pd = fetch_predecode(PC);
+    if (!pd->pd_decoded)
+        predecode_instr(pd->pd_insnbits, pd->pd_op, pd);
+    return pd;
+}
+
+/*
+ * Fetch stage logic.
+ * Memory is read and the opcode looked up only on a predecode miss. The
+ * L1I only decides when the instruction arrives: until it does, F is
+ * bubbled and the same PC is fetched again next cycle.
+ */
+
+comb_logic_t
+fetch_instr(pipe_reg_t *const F) {
+    select_PC(F->in->pred_PC,
+              guest.proc->x_insn->in->op, X_condval,
+              guest.proc->x_insn->in->pred_taken,
+              guest.proc->x_insn->in->seq_succ_PC,
+              guest.proc->x_insn->in->target_PC,
+              guest.proc->x_insn->in->op,
+              guest.proc->x_insn->in->val_a,
+              &current_PC);
+
+    predecode_ptr_t pd = fetch_predecode(current_PC);
+    F->out->insnbits = pd->pd_insnbits;
+    F->out->op = pd->pd_op;
+
+    predict_PC(current_PC, F->out->insnbits, F->out->op,
+               &pred_pc, &F->out->seq_succ_PC);
+    predict_branch(current_PC, pd->pd_target, F->out, &pred_pc);
+
+    mem_fetch(current_PC);
+    if (imem_status == IN_FLIGHT)
+        pred_pc = current_PC;
+    return;
+}
+
+/*
+ * Decode stage logic.
+ * The fields that depend only on the instruction bits come from the
+ * predecode entry filled at fetch, decoded on first use. Bubbles, and
+ * instructions whose entry has since been replaced, are decoded afresh.
+ */
+
+comb_logic_t
+decode_instr(pipe_reg_t *const D) {
+    predecode_entry_t local;
+    predecode_ptr_t pd = predecode_lookup(D->in->seq_succ_PC - 4);
+    if (NULL == pd || pd->pd_insnbits != D->in->insnbits || pd->pd_op != D->in->op) {
+        pd = &local;
+        pd->pd_decoded = false;
+    }
+    if (!pd->pd_decoded)
+        predecode_instr(D->in->insnbits, D->in->op, pd);
+
+    D->out->seq_succ_PC = D->in->seq_succ_PC;
+    D->out->op = D->in->op;
+    D->out->target_PC = D->in->target_PC;
+    D->out->pred_hist = D->in->pred_hist;
+    D->out->pred_dir = D->in->pred_dir;
+    D->out->pred_taken = D->in->pred_taken;
+    D->out->ras_tos = D->in->ras_tos;
+    D->out->ras_count = D->in->ras_count;
+    D->out->X_sigs = pd->pd_X_sigs;
+    D->out->M_sigs = pd->pd_M_sigs;
+    D->out->W_sigs = pd->pd_W_sigs;
+    uint8_t dst = guest.proc->w_insn->in->W_sigs.dst_sel ? 30 : guest.proc->w_insn->in->dst;
+    regfile(pd->pd_src1, pd->pd_src2, dst, W_wval, pd->pd_D_sigs.src1_31isSP, pd->pd_D_sigs.src2_31isSP, guest.proc->w_insn->in->W_sigs.dst_31isSP, guest.proc->w_insn->in->W_sigs.w_enable, &D->out->val_a, &D->out->val_b);
+    forward_reg(pd->pd_src1, pd->pd_src2, guest.proc->x_insn->in->dst, guest.proc->m_insn->in->dst, guest.proc->w_insn->in->dst, guest.proc->x_insn->out->val_ex, guest.proc->m_insn->in->val_ex, guest.proc->m_insn->out->val_mem, guest.proc->w_insn->in->val_ex, guest.proc->w_insn->in->val_mem, guest.proc->m_insn->in->W_sigs.wval_sel, guest.proc->w_insn->in->W_sigs.wval_sel, &D->out->val_a, &D->out->val_b);
+    D->out->val_imm = pd->pd_has_imm ? pd->pd_imm : 0;
+    D->out->cond = pd->pd_cond;
+
+    D->out->dst = pd->pd_dst;
+    D->out->val_hw = pd->pd_hw;
+    D->out->ALU_op = pd->pd_ALU_op;
+    return;
+}
+
+/*
+ * Execute stage logic.
+ */
+
+comb_logic_t
+execute_instr(pipe_reg_t *const X) {
+    copy_m_ctl_sigs(X);
+    copy_w_ctl_sigs(X);
+    X->out->seq_succ_PC = X->in->seq_succ_PC;
+    X->out->op = X->in->op;
+    X->out->target_PC = X->in->target_PC;
+    X->out->pred_hist = X->in->pred_hist;
+    X->out->pred_dir = X->in->pred_dir;
+    X->out->pred_taken = X->in->pred_taken;
+    X->out->ras_tos = X->in->ras_tos;
+    X->out->ras_count = X->in->ras_count;
+    X->out->val_b = X->in->val_b;
+    X->out->dst = X->in->dst;
+    X->out->ALU_op = X->in->ALU_op;
+    alu(X->in->val_a, X->in->X_sigs.valb_sel ? X->in->val_imm : X->in->val_b,
+        X->in->val_hw, X->in->ALU_op, X->in->X_sigs.set_CC, X->in->cond,
+        &X->out->val_ex, &X_condval);
+    return;
+}
+
+/*
+ * Memory stage logic.
+ */
+
+comb_logic_t
+memory_instr(pipe_reg_t *const M) {
+    bool dmem_err;
+    copy_w_ctl_sigs(M);
+    copy_m_ctl_sigs(M);
+    M->out->seq_succ_PC = M->in->seq_succ_PC;
+    M->out->op = M->in->op;
+    M->out->val_ex = M->in->val_ex;
+    M->out->val_b = M->in->val_b;
+    M->out->dst = M->in->dst;
+    M->out->val_mem = 0;
+    dmem(M->in->val_ex, M->in->val_b,
+         M->in->M_sigs.dmem_read, M->in->M_sigs.dmem_write,
+         &M->out->val_mem, &dmem_err);
+    return;
+}
+
+/*
+ * Write-back stage logic.
+ */
+
+comb_logic_t
+wback_instr(pipe_reg_t *const W) {
+    copy_w_ctl_sigs(W);
+    W->out->op = W->in->op;
+    W->out->dst = W->in->dst;
+    W->out->val_ex = W->in->val_ex;
+    W->out->val_mem = W->in->val_mem;
+    W_wval = W->in->W_sigs.wval_sel ? W->in->val_mem : W->in->val_ex;
+    W_wval = W->in->W_sigs.dst_sel ? W->in->seq_succ_PC : W_wval;
+    return;
+}
+
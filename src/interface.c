@@ -11,6 +11,10 @@
 
 #include "archsim.h"
 #include "ansicolors.h"
+#include "ptable.h"
+#include "console.h"
+#include "bpred.h"
+#include "hier.h"
 
 static char default_ae_prompt[] = ANSI_BOLD ANSI_COLOR_BLUE "UTCS429-S2022-archsim>>> " ANSI_RESET;
 static const char author[] = ANSI_BOLD ANSI_COLOR_RED "Reference Implementation" ANSI_RESET;
@@ -29,8 +33,11 @@ void init(void) {
     outfile = stdout;
     errfile = stderr;
     if (! ae_prompt) ae_prompt = default_ae_prompt;
+    console_init();
     init_machine("AArch64", 64, L_ENDIAN, L_ENDIAN);
     init_itable();
+    bpred_init();
+    perf_reset();
     if (outfile != stdout) {
         ae_prompt = "";
         return;
@@ -41,6 +48,11 @@ void init(void) {
 }
 
 void finalize(void) {
+    free_ptable();
+    if (bpred_report)
+        bpred_print_stats(outfile);
+    perf_print(outfile);
+    hier_print_stats(outfile);
     if (outfile != stdout) return;
     time_t t;
     assert(time(&t) != -1);
@@ -0,0 +1,448 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * jit.c - A basic-block translator from guest instructions to x86-64 host
+ * code, used by the functional model.
+ *
+ * A block runs from its first instruction up to and including the next
+ * branch. It is translated from the predecoded signals of its instructions,
+ * so it computes exactly what regfile, alu and dmem would. Guest registers
+ * stay in the register file; the host code addresses them directly, and
+ * goes through dmem for every load and store.
+ *
+ * Blocks are chained: once the successor of a static exit is translated,
+ * the exit jumps straight to it. Every block first charges its length
+ * against an instruction budget, so a run stops at an exact count. An
+ * instruction the translator does not handle ends the block, and the
+ * caller interprets it.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jit.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+#include "err_handler.h"
+#include "hw_elts.h"
+#include "machine.h"
+#include "predecode.h"
+#include "ptable.h"
+
+extern machine_t guest;
+
+// Host registers, in x86-64 encoding order.
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* While translated code runs, RBX points to the general-purpose registers,
+ * R12 to SP, R13 to NZCV, R14 holds the remaining instruction budget and
+ * R15 points to the context below.
+ */
+typedef struct jit_ctx {
+    gpregval_t *jc_GPR;
+    gpregval_t *jc_SP;
+    gpregval_t *jc_NZCV;
+    int64_t jc_budget;
+    uint8_t *jc_exit;   // The jump to patch to chain this exit, or NULL.
+    uint64_t jc_ret_PC; // Address of the RET that left the last block.
+} jit_ctx_t;
+
+#define CTX_BUDGET 24
+#define CTX_EXIT 32
+#define CTX_RET_PC 40
+
+typedef struct jit_block {
+    uint64_t jb_PC;
+    uint8_t *jb_code;
+    unsigned jb_len;
+} jit_block_t;
+
+// A bound on the host code for one block, checked before translating it.
+#define JIT_BLOCK_BYTES (JIT_MAX_BLOCK * 160 + 128)
+
+static uint8_t *code_buf;
+static uint8_t *code_ptr;
+static uint8_t *code_start;  // First byte after the entry and exit stubs.
+static uint8_t *exit_stub;
+static uint64_t (*jit_enter)(uint8_t *, jit_ctx_t *);
+static jit_block_t jit_blocks[JIT_BLOCKS];
+static uint64_t jit_gen;     // Bumped on every flush.
+static uint64_t jit_stop_PC;
+static uint16_t cond_mask[16];
+
+static void emit1(uint8_t b) { *code_ptr++ = b; }
+static void emit4(uint32_t v) { memcpy(code_ptr, &v, 4); code_ptr += 4; }
+static void emit8(uint64_t v) { memcpy(code_ptr, &v, 8); code_ptr += 8; }
+
+static void emit_rex(bool w, unsigned reg, unsigned rm) {
+    uint8_t rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | ((rm >> 3) & 1);
+    if (rex != 0x40) emit1(rex);
+}
+
+// op reg, rm for two registers, e.g. 0x01 is add rm, reg.
+static void emit_rr(uint8_t op, unsigned rm, unsigned reg) {
+    emit_rex(true, reg, rm);
+    emit1(op);
+    emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op reg, [base + disp].
+static void emit_mem(bool w, uint8_t op, unsigned reg, unsigned base, int32_t disp) {
+    emit_rex(w, reg, base);
+    emit1(op);
+    emit1(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) emit1(0x24);
+    emit4(disp);
+}
+
+static void emit_mov_imm(unsigned reg, uint64_t imm) {
+    emit_rex(true, 0, reg);
+    emit1(0xB8 + (reg & 7));
+    emit8(imm);
+}
+
+static void emit_zero(unsigned reg) {
+    emit_rex(false, reg, reg);
+    emit1(0x31);
+    emit1(0xC0 | ((reg & 7) << 3) | (reg & 7));
+}
+
+static void emit_call(void *fn) {
+    emit_mov_imm(RAX, (uint64_t) fn);
+    emit1(0xFF); emit1(0xD0);               // call rax
+}
+
+// Budget adjustment, add or sub r14, imm32.
+static void emit_budget(bool add, uint32_t n) {
+    emit1(0x49); emit1(0x81); emit1(add ? 0xC6 : 0xEE);
+    emit4(n);
+}
+
+static void emit_jmp(uint8_t *target) {
+    emit1(0xE9);
+    emit4((uint32_t) (target - (code_ptr + 4)));
+}
+
+// A conditional jump with a rel32 to be patched; returns the rel32 field.
+static uint8_t *emit_jcc(uint8_t cc) {
+    emit1(0x0F); emit1(cc);
+    emit4(0);
+    return code_ptr - 4;
+}
+
+static void patch_rel32(uint8_t *field) {
+    uint32_t rel = (uint32_t) (code_ptr - (field + 4));
+    memcpy(field, &rel, 4);
+}
+
+static void emit_read_reg(unsigned host, uint8_t src, bool is_SP) {
+    if (src == 31) {
+        if (is_SP) emit_mem(true, 0x8B, host, R12, 0);
+        else emit_zero(host);
+    }
+    else emit_mem(true, 0x8B, host, RBX, 8 * src);
+}
+
+// Leave the block with rax = PC. A chainable exit records its jump.
+static void emit_exit(uint64_t PC, bool chainable) {
+    emit_mov_imm(RAX, PC);
+    if (chainable) {
+        emit1(0x48); emit1(0x8D); emit1(0x0D); emit4(0); // lea rcx, [rip]
+    }
+    else emit_zero(RCX);
+    emit_jmp(exit_stub);
+}
+
+static uint64_t jit_load(uint64_t addr) {
+    uint64_t val;
+    bool err;
+    dmem_complete(addr, 0, true, false, &val, &err);
+    return val;
+}
+
+static void jit_store(uint64_t addr, uint64_t val) {
+    uint64_t unused;
+    bool err;
+    dmem_complete(addr, val, false, true, &unused, &err);
+}
+
+/* The condition masks come from alu() itself, so translated B.cond can
+ * never disagree with the interpreter. Bit i of cond_mask[c] is set if c
+ * holds when NZCV is i.
+ */
+static void init_cond_masks(void) {
+    int64_t saved = guest.proc->NZCV.bits->xval;
+    for (int c = 0; c < 16; c++) {
+        for (int cc = 0; cc < 16; cc++) {
+            uint64_t unused;
+            bool holds;
+            guest.proc->NZCV.bits->ccval = cc;
+            alu(0, 0, 0, PASS_A_OP, false, c, &unused, &holds);
+            if (holds) cond_mask[c] |= 1 << cc;
+        }
+    }
+    guest.proc->NZCV.bits->xval = saved;
+}
+
+static void jit_init(void) {
+    code_buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code_buf == MAP_FAILED) {
+        logging(LOG_FATAL, "failed to map memory for translated code");
+        exit(EXIT_FAILURE);
+    }
+    code_ptr = code_buf;
+
+    // uint64_t jit_enter(uint8_t *code, jit_ctx_t *ctx)
+    jit_enter = (uint64_t (*)(uint8_t *, jit_ctx_t *)) code_ptr;
+    emit1(0x53);                            // push rbx
+    emit1(0x41); emit1(0x54);               // push r12
+    emit1(0x41); emit1(0x55);               // push r13
+    emit1(0x41); emit1(0x56);               // push r14
+    emit1(0x41); emit1(0x57);               // push r15
+    emit_mem(true, 0x8B, RBX, RSI, 0);
+    emit_mem(true, 0x8B, R12, RSI, 8);
+    emit_mem(true, 0x8B, R13, RSI, 16);
+    emit_mem(true, 0x8B, R14, RSI, CTX_BUDGET);
+    emit_rr(0x89, R15, RSI);                // mov r15, rsi
+    emit1(0xFF); emit1(0xE7);               // jmp rdi
+
+    exit_stub = code_ptr;
+    emit_mem(true, 0x89, R14, R15, CTX_BUDGET);
+    emit_mem(true, 0x89, RCX, R15, CTX_EXIT);
+    emit1(0x41); emit1(0x5F);               // pop r15
+    emit1(0x41); emit1(0x5E);               // pop r14
+    emit1(0x41); emit1(0x5D);               // pop r13
+    emit1(0x41); emit1(0x5C);               // pop r12
+    emit1(0x5B);                            // pop rbx
+    emit1(0xC3);                            // ret
+
+    code_start = code_ptr;
+    init_cond_masks();
+}
+
+void jit_flush(void) {
+    if (code_buf == NULL) return;
+    memset(jit_blocks, 0, sizeof(jit_blocks));
+    code_ptr = code_start;
+    jit_gen++;
+}
+
+static bool is_branch(opcode_t op) {
+    return op == OP_B || op == OP_B_COND || op == OP_BL || op == OP_RET;
+}
+
+/* Translate one instruction of a block, at index k of n. */
+static void translate_instr(predecode_ptr_t pd, unsigned k, unsigned n) {
+    bool mem = pd->pd_M_sigs.dmem_read || pd->pd_M_sigs.dmem_write;
+    if (!pd->pd_W_sigs.w_enable && !pd->pd_X_sigs.set_CC && !mem && pd->pd_op != OP_RET)
+        return;
+
+    // val_a in rax, the second ALU operand in rcx, val_ex in rdx.
+    emit_read_reg(RAX, pd->pd_src1, pd->pd_D_sigs.src1_31isSP);
+    if (pd->pd_X_sigs.valb_sel) emit_mov_imm(RCX, (uint64_t) pd->pd_imm);
+    else emit_read_reg(RCX, pd->pd_src2, pd->pd_D_sigs.src2_31isSP);
+
+    if (pd->pd_ALU_op != PASS_B_OP && pd->pd_ALU_op != MOV_OP)
+        emit_rr(0x89, RDX, RAX);
+    switch (pd->pd_ALU_op) {
+        case PLUS_OP: emit_rr(0x01, RDX, RCX); break;
+        case MINUS_OP: emit_rr(0x29, RDX, RCX); break;
+        case NEG_OP: emit_rex(true, 0, RDX); emit1(0xF7); emit1(0xD2); break;
+        case OR_OP: emit_rr(0x09, RDX, RCX); break;
+        case EOR_OP: emit_rr(0x31, RDX, RCX); break;
+        case AND_OP: emit_rr(0x21, RDX, RCX); break;
+        case MOV_OP:
+            emit_rr(0x89, RDX, RCX);
+            if (pd->pd_hw) { emit1(0x48); emit1(0xC1); emit1(0xE2); emit1(pd->pd_hw); }
+            emit_rr(0x09, RDX, RAX);
+            break;
+        case LSL_OP: emit1(0x48); emit1(0xD3); emit1(0xE2); break;
+        case LSR_OP: emit1(0x48); emit1(0xD3); emit1(0xEA); break;
+        case ASR_OP: emit1(0x48); emit1(0xD3); emit1(0xFA); break;
+        case PASS_A_OP: break;
+        case PASS_B_OP: emit_rr(0x89, RDX, RCX); break;
+        case ERROR_OP: IMPOSSIBLE(); break;
+    }
+
+    if (pd->pd_X_sigs.set_CC && (pd->pd_ALU_op == PLUS_OP || pd->pd_ALU_op == MINUS_OP)) {
+        // r8 = N<<3 | Z<<2 | C<<1 | V, as alu() computes them.
+        emit_rr(0x89, R8, RDX);
+        emit1(0x49); emit1(0xC1); emit1(0xE8); emit1(63);  // shr r8, 63
+        emit1(0x41); emit1(0xC1); emit1(0xE0); emit1(3);   // shl r8d, 3
+        emit_zero(R9);
+        emit_rr(0x85, RDX, RDX);                           // test rdx, rdx
+        emit1(0x41); emit1(0x0F); emit1(0x94); emit1(0xC1); // sete r9b
+        emit1(0x41); emit1(0xC1); emit1(0xE1); emit1(2);   // shl r9d, 2
+        emit1(0x45); emit1(0x09); emit1(0xC8);             // or r8d, r9d
+        emit_zero(R9);
+        emit_rr(0x39, RDX, RAX);                           // cmp rdx, rax
+        emit1(0x41); emit1(0x0F); emit1(0x92); emit1(0xC1); // setb r9b
+        emit1(0x45); emit1(0x01); emit1(0xC9);             // add r9d, r9d
+        emit1(0x45); emit1(0x09); emit1(0xC8);             // or r8d, r9d
+        emit_zero(R9);
+        emit_rr(0x89, R10, RAX);
+        emit_rr(0x01, R10, RCX);                           // add r10, rcx
+        emit1(0x41); emit1(0x0F); emit1(0x90); emit1(0xC1); // seto r9b
+        emit1(0x45); emit1(0x09); emit1(0xC8);             // or r8d, r9d
+        emit_mem(false, 0x88, R8, R13, 0);                 // mov [r13], r8b
+    }
+
+    if (pd->pd_M_sigs.dmem_write) {
+        emit_read_reg(RSI, pd->pd_src2, pd->pd_D_sigs.src2_31isSP);
+        emit_rr(0x89, RDI, RDX);
+        emit_call(jit_store);
+        // A store to a translated page flushes, so leave the stale block.
+        emit_mov_imm(RAX, (uint64_t) &jit_gen);
+        emit1(0x48); emit1(0x81); emit1(0x38); emit4((uint32_t) jit_gen); // cmp [rax], gen
+        uint8_t *same = emit_jcc(0x84);
+        emit_budget(true, n - k - 1);
+        emit_exit(pd->pd_PC + 4, false);
+        patch_rel32(same);
+    }
+    if (pd->pd_M_sigs.dmem_read) {
+        emit_rr(0x89, RDI, RDX);
+        emit_call(jit_load);
+        if (pd->pd_W_sigs.wval_sel) emit_rr(0x89, RDX, RAX);
+    }
+
+    if (pd->pd_W_sigs.w_enable) {
+        if (pd->pd_W_sigs.dst_sel) emit_mov_imm(RDX, pd->pd_PC + 4);
+        if (pd->pd_dst != 31) emit_mem(true, 0x89, RDX, RBX, 8 * pd->pd_dst);
+        else if (pd->pd_W_sigs.dst_31isSP) emit_mem(true, 0x89, RDX, R12, 0);
+    }
+}
+
+/* Translate the block at PC. A block stops short of a HLT, a page
+ * boundary and the stop PC, so that the caller sees each of them at the
+ * start of a block. Returns NULL if nothing could be translated.
+ */
+static jit_block_t *translate(uint64_t PC) {
+    if (code_buf + JIT_CODE_SIZE - code_ptr < JIT_BLOCK_BYTES)
+        jit_flush();
+
+    predecode_ptr_t pds[JIT_MAX_BLOCK];
+    unsigned n = 0;
+    for (uint64_t pc = PC; n < JIT_MAX_BLOCK; pc += 4) {
+        if (n > 0 && (pc == jit_stop_PC || pc % PAGESIZE == 0))
+            break;
+        predecode_ptr_t pd = predecode_at(pc);
+        if (pd->pd_op == OP_HLT)
+            break;
+        pds[n++] = pd;
+        if (is_branch(pd->pd_op))
+            break;
+    }
+    if (n == 0) return NULL;
+
+    jit_block_t *blk = &jit_blocks[(PC >> 2) % JIT_BLOCKS];
+    blk->jb_PC = PC;
+    blk->jb_code = code_ptr;
+    blk->jb_len = n;
+
+    // Charge the block against the budget, or leave without running it.
+    emit1(0x49); emit1(0x81); emit1(0xFE); emit4(n); // cmp r14, n
+    uint8_t *enough = emit_jcc(0x8D);                // jge
+    emit_exit(PC, false);
+    patch_rel32(enough);
+    emit_budget(false, n);
+
+    for (unsigned k = 0; k < n; k++)
+        translate_instr(pds[k], k, n);
+
+    predecode_ptr_t last = pds[n-1];
+    switch (last->pd_op) {
+        case OP_B:
+        case OP_BL:
+            emit_exit(last->pd_target, true);
+            break;
+        case OP_B_COND: {
+            emit1(0x41); emit1(0x0F); emit1(0xB6);          // movzx eax, byte [r13]
+            emit1(0x85); emit4(0);
+            emit1(0xB9); emit4(cond_mask[last->pd_cond]);   // mov ecx, mask
+            emit1(0x0F); emit1(0xA3); emit1(0xC1);          // bt ecx, eax
+            uint8_t *not_taken = emit_jcc(0x83);            // jnc
+            emit_exit(last->pd_target, true);
+            patch_rel32(not_taken);
+            emit_exit(last->pd_PC + 4, true);
+            break;
+        }
+        case OP_RET:
+            emit_mov_imm(RCX, last->pd_PC);
+            emit_mem(true, 0x89, RCX, R15, CTX_RET_PC);
+            emit_zero(RCX);
+            emit_jmp(exit_stub);
+            break;
+        default:
+            emit_exit(last->pd_PC + 4, true);
+            break;
+    }
+    return blk;
+}
+
+static jit_block_t *lookup(uint64_t PC) {
+    jit_block_t *blk = &jit_blocks[(PC >> 2) % JIT_BLOCKS];
+    if (blk->jb_code != NULL && blk->jb_PC == PC) return blk;
+    return NULL;
+}
+
+/* Run translated code from *PC until max_instr more instructions have
+ * retired (0 for no limit), the PC reaches stop_PC, or the next
+ * instruction must be interpreted. A RET to RET_FROM_MAIN_ADDR is undone
+ * and left to the interpreter, which ends the run.
+ */
+void jit_run(uint64_t *PC, const uint64_t max_instr, const uint64_t stop_PC,
+             uint64_t *num_instr) {
+    if (code_buf == NULL) jit_init();
+    if (stop_PC != jit_stop_PC) {
+        jit_flush();
+        jit_stop_PC = stop_PC;
+    }
+    jit_ctx_t ctx = {guest.proc->GPR.bits, guest.proc->SP.bits, guest.proc->NZCV.bits,
+                     0, NULL, 0};
+    int64_t budget = (max_instr && max_instr < INT64_MAX) ? (int64_t) max_instr : INT64_MAX;
+
+    while (!(stop_PC && *PC == stop_PC)) {
+        jit_block_t *blk = lookup(*PC);
+        if (blk == NULL && (blk = translate(*PC)) == NULL)
+            return;
+        if (blk->jb_len > budget)
+            return;
+
+        uint64_t gen = jit_gen;
+        ctx.jc_budget = budget;
+        uint64_t next = jit_enter(blk->jb_code, &ctx);
+        *num_instr += budget - ctx.jc_budget;
+        budget = ctx.jc_budget;
+
+        if (next == RET_FROM_MAIN_ADDR) {
+            *PC = ctx.jc_ret_PC;
+            (*num_instr)--;
+            return;
+        }
+        *PC = next;
+
+        // Chain the exit once its successor exists, unless a store flushed.
+        jit_block_t *succ = lookup(next);
+        if (ctx.jc_exit != NULL && gen == jit_gen && succ != NULL && next != stop_PC) {
+            uint8_t *jmp = ctx.jc_exit;
+            uint32_t rel = (uint32_t) (succ->jb_code - (jmp + 5));
+            memcpy(jmp + 1, &rel, 4);
+        }
+    }
+}
+
+#else
+
+// No translator for this host; the functional model interprets everything.
+void jit_run(uint64_t *PC, const uint64_t max_instr, const uint64_t stop_PC,
+             uint64_t *num_instr) {}
+
+void jit_flush(void) {}
+
+#endif
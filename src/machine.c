@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "machine.h"
+#include "hier.h"
 
 /* Created from command-line arguments */
 #ifdef CACHE
@@ -20,6 +21,7 @@ extern uint64_t inflight_cycles;
 extern uint64_t inflight_addr;
 extern bool inflight;
 extern mem_status_t dmem_status;
+extern mem_status_t imem_status;
 #endif
 
 static uint64_t seg_starts[] = {
@@ -63,10 +65,11 @@ void init_machine(char *name, unsigned word_size, byte_order_t code_order, byte_
     }
 
 #ifdef CACHE
-    guest.cache = create_cache(s, b, E, d);
-    inflight_cycles = guest.cache->d;
+    guest.cache = hier_init(s, b, E, d);
+    inflight_cycles = 0;
     inflight_addr = 0;
     inflight = false;
     dmem_status = READY;
+    imem_status = READY;
 #endif
 }
\ No newline at end of file
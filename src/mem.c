@@ -13,11 +13,17 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "err_handler.h"
 #include "mem.h"
 #include "ptable.h"
+#include "tlb.h"
+#include "predecode.h"
+#include "jit.h"
 #include "machine.h"
+#include "console.h"
+#include "hier.h"
 
 extern machine_t guest;
 
@@ -25,7 +31,14 @@ extern machine_t guest;
 extern uint64_t inflight_cycles;
 extern uint64_t inflight_addr;
 extern bool inflight;
+extern perf_cause_t inflight_cause;
 extern mem_status_t dmem_status;
+extern mem_status_t imem_status;
+
+// The L1I miss in flight, if any. Fetch has no faults to check first.
+static uint64_t ifetch_cycles;
+static uint64_t ifetch_addr;
+static bool ifetch_inflight;
 #endif
 
 const uint64_t NULL_ADDR = 0x0UL;
@@ -55,27 +68,133 @@ static uint8_t get_prot_bits(const uint64_t addr) {
     return guest.mem->seg_prot[KERNEL_SEG];
 }
 
-static uint8_t _mem_read_byte(const uint64_t addr) {
+static void _mem_fault(const uint64_t addr, const uint8_t access) {
+    char printbuf[100];
+    sprintf(printbuf, "Protection fault on %s of address 0x%lx", 
+            (access & PROT_W) ? "write" : (access & PROT_X) ? "execute" : "read", addr);
+    logging(LOG_FATAL, printbuf);
+    exit(EXIT_FAILURE);
+}
+
+/* Resolve the page holding addr, through the TLB, creating it if needed.
+ * Protection and byte order are computed once from the segment table when
+ * the page is created. In user mode, an access not permitted by the page's
+ * protection faults before any page is allocated or any byte is touched.
+ * Untouched pages that are read map the shared zero page; a private page
+ * is allocated on the first write. A write to a page holding pre-decoded
+ * instructions drops them first.
+ */
+static tlb_entry_ptr_t _mem_translate(const uint64_t addr, const uint8_t access) {
     uint64_t pnum = addr / PAGESIZE;
-    uint64_t poff = addr % PAGESIZE;
-    pte_ptr_t page = get_page(pnum);
-    if (NULL == page)
-        page = add_page(pnum, get_prot_bits(addr));
-    return page->p_data[poff];
+    tlb_entry_ptr_t t = tlb_lookup(pnum);
+    if (NULL == t) {
+        pte_ptr_t page = get_page(pnum);
+        if (NULL == page) {
+            uint8_t prot = get_prot_bits(addr);
+            if (MODE_USER == guest.mode && access != (prot & access))
+                _mem_fault(addr, access);
+            if (access & PROT_W)
+                page = add_page(pnum, prot, get_byte_order(addr));
+            else
+                page = add_zero_page(pnum, prot, get_byte_order(addr));
+        }
+        t = tlb_fill(page);
+    }
+    if (MODE_USER == guest.mode && access != (t->t_prot & access))
+        _mem_fault(addr, access);
+    if ((access & PROT_W) && t->t_zero) {
+        pte_ptr_t page = get_page(pnum);
+        cow_page(page);
+        t = tlb_fill(page);
+    }
+    if ((access & PROT_W) && t->t_code) {
+        predecode_invalidate_page(pnum);
+        jit_flush();
+        t = tlb_fill(get_page(pnum));
+    }
+    return t;
+}
+
+/* Map every page overlapping [addr, addr+len) with protection prot,
+ * overriding the segment table for those pages.
+ */
+void mem_map(const uint64_t addr, const uint64_t len, const uint8_t prot) {
+    for (uint64_t pnum = addr / PAGESIZE; pnum <= (addr+len-1) / PAGESIZE; pnum++) {
+        pte_ptr_t page = get_page(pnum);
+        if (NULL == page)
+            page = add_zero_page(pnum, prot, get_byte_order(pnum * PAGESIZE));
+        page->p_prot = prot;
+        tlb_invalidate(pnum);
+    }
+}
+
+/* Bulk-load a segment: copy filesz bytes from data to guest address vaddr
+ * page by page, then zero-fill up to memsz bytes. Pages lying wholly in the
+ * zero-filled tail are mapped onto the shared zero page.
+ */
+void mem_load(const uint64_t vaddr, const uint8_t *data, const uint64_t filesz, const uint64_t memsz) {
+    uint64_t end = vaddr + memsz;
+    for (uint64_t addr = vaddr; addr < end; ) {
+        uint64_t poff = addr % PAGESIZE;
+        uint64_t done = addr - vaddr;
+        uint64_t n = PAGESIZE - poff;
+        if (n > end - addr) n = end - addr;
+        if (done < filesz) {
+            uint64_t nfile = (n < filesz - done) ? n : filesz - done;
+            char *page = _mem_translate(addr, PROT_W)->t_data;
+            memcpy(page + poff, data + done, nfile);
+            memset(page + poff + nfile, 0, n - nfile);
+        }
+        else {
+            // An untouched page reads as the zero page. Nothing is
+            // pre-decoded yet, so a private page is written directly.
+            tlb_entry_ptr_t t = _mem_translate(addr, PROT_R);
+            if (!t->t_zero)
+                memset(t->t_data + poff, 0, n);
+        }
+        addr += n;
+    }
+}
+
+/* Copy width bytes at addr, whose first page has already been translated
+ * to t, to or from buf. An access straddling a page boundary translates the
+ * second page as well.
+ */
+static void _mem_copy_in(const uint64_t addr, uint8_t *buf, const unsigned width,
+                         const tlb_entry_ptr_t t, const uint8_t access) {
+    unsigned n = PAGESIZE - addr % PAGESIZE;
+    if (n >= width) {
+        memcpy(buf, t->t_data + addr % PAGESIZE, width);
+        return;
+    }
+    memcpy(buf, t->t_data + addr % PAGESIZE, n);
+    memcpy(buf + n, _mem_translate(addr + n, access)->t_data, width - n);
+}
+
+static void _mem_copy_out(const uint64_t addr, const uint8_t *buf, const unsigned width,
+                          const tlb_entry_ptr_t t) {
+    unsigned n = PAGESIZE - addr % PAGESIZE;
+    if (n >= width) {
+        memcpy(t->t_data + addr % PAGESIZE, buf, width);
+        return;
+    }
+    memcpy(t->t_data + addr % PAGESIZE, buf, n);
+    memcpy(_mem_translate(addr + n, PROT_W)->t_data, buf + n, width - n);
 }
 
-static uint64_t _mem_read_LE(const uint64_t addr, const unsigned width) {
+/* The word-granular paths below rely on the host being little-endian. */
+static uint64_t _mem_read_LE(const uint64_t addr, const unsigned width,
+                             const tlb_entry_ptr_t t, const uint8_t access) {
     uint64_t retval = 0ULL;
-    for (int i = width-1; i >= 0; i--)
-        retval = (retval << 8) + _mem_read_byte(addr+i);
+    _mem_copy_in(addr, (uint8_t *) &retval, width, t, access);
     return retval;
 }
 
-static uint64_t _mem_read_BE(const uint64_t addr, const unsigned width) {
+static uint64_t _mem_read_BE(const uint64_t addr, const unsigned width,
+                             const tlb_entry_ptr_t t, const uint8_t access) {
     uint64_t retval = 0ULL;
-    for (int i = 0; i < width; i++)
-        retval = (retval << 8) + _mem_read_byte(addr+i);
-    return retval;
+    _mem_copy_in(addr, (uint8_t *) &retval, width, t, access);
+    return __builtin_bswap64(retval) >> (64 - 8*width);
 }
 
 static uint64_t _mem_read_special(const uint64_t addr, const unsigned width) {
@@ -83,64 +202,48 @@ static uint64_t _mem_read_special(const uint64_t addr, const unsigned width) {
         logging(LOG_FATAL, "Null pointer read attempt");
         exit(EXIT_FAILURE);
     }
-    if (IO_CHAR_ADDR == addr) {
-        uint8_t data8;
-        uint16_t data16;
-        uint32_t data32;
-        uint64_t data64;
-        switch (width) {
-            case 1: scanf("%c\n", &data8); return (char) (data8&0xFFU); break;
-            case 2: scanf("%hd\n", &data16); return (short) (data16 & 0xFFFFU); break;
-            case 4: scanf("%d\n", &data32); return (int) (data32 & 0xFFFFFFFFU); break;
-            case 8: scanf("%ld\n", &data64); return (long) data64; break;
-            default: assert(false); break;
-        }
-    }
+    if (IO_CHAR_ADDR == addr)
+        return console_read(width);
     if (RET_FROM_MAIN_ADDR == addr) {return 0;}
     assert(false); return 0;
 }
 
-uint64_t _mem_read(const uint64_t addr, const unsigned width) {
+/* A read needing access, PROT_R for data and PROT_X for instructions. */
+static uint64_t _mem_read_access(const uint64_t addr, const unsigned width, const uint8_t access) {
     if (is_special_addr(addr))
         return _mem_read_special(addr, width);
 
-    byte_order_t b = get_byte_order(addr);
-    switch (b) {
+    tlb_entry_ptr_t t = _mem_translate(addr, access);
+    switch (t->t_order) {
         case L_ENDIAN:
-            return _mem_read_LE(addr, width);
+            return _mem_read_LE(addr, width, t, access);
         case B_ENDIAN:
-            return _mem_read_BE(addr, width);
+            return _mem_read_BE(addr, width, t, access);
         default:
             assert(false); return 0;
     }
 }
 
-static write_ret_code_t _mem_write_byte(const uint64_t addr, const uint8_t data) {
-    uint64_t pnum = addr / PAGESIZE;
-    uint64_t poff = addr % PAGESIZE;
-    pte_ptr_t page = get_page(pnum);
-    if (NULL == page) {
-        page = add_page(pnum, 7);//FIX.
-    }
-    page->p_data[poff] = data;
-    //printf("%lx:%lx: %x\n", pnum, poff, data);
-    return WRITE_SUCCESS;
+uint64_t _mem_read(const uint64_t addr, const unsigned width) {
+    return _mem_read_access(addr, width, PROT_R);
 }
 
-static write_ret_code_t _mem_write_LE(const uint64_t addr, const uint64_t data, const unsigned width) {
-    uint8_t *s = (uint8_t *) &data;
-    write_ret_code_t retval = WRITE_FAILURE;
-    for (int i = 0; i < width; i++)
-        retval |= _mem_write_byte(addr+i, s[i]);
-    return retval;
+// Instruction fetch, which needs the page to be executable.
+uint32_t mem_read_insn(const uint64_t addr) {
+    return (uint32_t) _mem_read_access(addr, 4, PROT_X);
 }
 
-static write_ret_code_t _mem_write_BE(const uint64_t addr, const uint64_t data, const unsigned width) {
-    uint8_t *s = (uint8_t *) &data;
-    write_ret_code_t retval = WRITE_FAILURE;
-    for (int i = 0; i < width; i++)
-        retval |= _mem_write_byte(addr+i, s[width-i-1]);
-    return retval;
+static write_ret_code_t _mem_write_LE(const uint64_t addr, const uint64_t data, const unsigned width,
+                                      const tlb_entry_ptr_t t) {
+    _mem_copy_out(addr, (const uint8_t *) &data, width, t);
+    return WRITE_SUCCESS;
+}
+
+static write_ret_code_t _mem_write_BE(const uint64_t addr, const uint64_t data, const unsigned width,
+                                      const tlb_entry_ptr_t t) {
+    uint64_t swapped = __builtin_bswap64(data << (64 - 8*width));
+    _mem_copy_out(addr, (const uint8_t *) &swapped, width, t);
+    return WRITE_SUCCESS;
 }
 
 static write_ret_code_t _mem_write_special(const uint64_t addr, const uint64_t data, const unsigned width) {
@@ -149,18 +252,7 @@ static write_ret_code_t _mem_write_special(const uint64_t addr, const uint64_t d
         return WRITE_SUCCESS;
     }
     if (IO_CHAR_ADDR == addr) {
-        switch (width) {
-            case 1: putchar(data & 0xFFU); break;
-            case 2: printf("%hd %0#4hx\n", (short) (data & 0xFFFFU), (short) (data & 0xFFFFU)); break;
-            case 4: printf("%d %0#8x\n", (int) (data & 0xFFFFFFFFU), (int) (data & 0xFFFFFFFFU)); break;
-            case 8: 
-                printf("%ld %0#16lx\n", (long) data, (long) data);
-                char printbuf[100];
-                sprintf(printbuf, "%ld %0#16lx", (long) data, (long) data);
-                logging(LOG_OUTPUT, printbuf);
-                break;
-            default: assert(false); break;
-        }
+        console_write(data, width);
         return WRITE_SUCCESS;    
     }
     assert(false); return WRITE_SUCCESS;
@@ -170,21 +262,51 @@ write_ret_code_t _mem_write(const uint64_t addr, const uint64_t data, const unsi
     if (is_special_addr(addr))
         return _mem_write_special(addr, data, width);
 
-    byte_order_t b = get_byte_order(addr);
-    switch (b) {
+    tlb_entry_ptr_t t = _mem_translate(addr, PROT_W);
+    switch (t->t_order) {
         case L_ENDIAN:
-            return _mem_write_LE(addr, data, width);
+            return _mem_write_LE(addr, data, width, t);
         case B_ENDIAN:
-            return _mem_write_BE(addr, data, width);
+            return _mem_write_BE(addr, data, width, t);
         default:
             return WRITE_FAILURE;
     }
 }
 
+/* Cache line fills and writebacks move whole blocks, copied straight
+ * between the line and each page they cover.
+ */
+void mem_read_block(const uint64_t addr, uint8_t *data, const unsigned len) {
+    for (unsigned j = 0, n; j < len; j += n) {
+        n = PAGESIZE - (addr + j) % PAGESIZE;
+        if (n > len - j)
+            n = len - j;
+        memcpy(data + j, _mem_translate(addr + j, PROT_R)->t_data + (addr + j) % PAGESIZE, n);
+    }
+}
+
+void mem_write_block(const uint64_t addr, const uint8_t *data, const unsigned len) {
+    for (unsigned j = 0, n; j < len; j += n) {
+        n = PAGESIZE - (addr + j) % PAGESIZE;
+        if (n > len - j)
+            n = len - j;
+        memcpy(_mem_translate(addr + j, PROT_W)->t_data + (addr + j) % PAGESIZE, data + j, n);
+    }
+}
+
 #ifdef CACHE
+/* Check protection on the access itself, so that a fault is raised by the
+ * offending load or store rather than by a later line fill or writeback.
+ */
+static void _mem_check_access(const uint64_t addr, const unsigned width, const uint8_t access) {
+    _mem_translate(addr, access);
+    _mem_translate(addr+width-1, access);
+}
+
 uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
     if (is_special_addr(addr))
         return _mem_read_special(addr, width);
+    _mem_check_access(addr, width, PROT_R);
 
     // byte_order_t b = get_byte_order(addr);
 
@@ -197,7 +319,7 @@ uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
             uword_t block_address = current_address & ~(B-1);
             if(inflight_addr != block_address || !inflight) {
                 inflight_addr = block_address;
-                inflight_cycles = guest.cache->d;
+                inflight_cycles = hier_latency(HIER_L1D, block_address, &inflight_cause);
                 inflight = true;
             }
 
@@ -208,28 +330,12 @@ uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
             }
 
             inflight = false;
-
-            uint8_t *block = calloc(B, 1);
-            for (int j = 0; j < B; j++) {
-                block[j] = _mem_read_LE((addr & ~(B-1))+j, 1);
-            }
-
-            evicted_line_t *evicted = handle_miss(guest.cache, block_address, READ, block);
-            data = *((uint64_t *)block + (addr & (B-1)));
-
-            if (evicted->valid && evicted->dirty) {
-                for (int j = 0; j < B; j++) {
-                    _mem_write_LE((evicted->addr & ~(B-1))+j, evicted->data[j], 1);
-                }
-            }
-
-            free(block);
-            free(evicted->data);
-            free(evicted);
+            hier_fill(HIER_L1D, block_address, READ);
         }
         current_address++;
     }
     get_word_cache(guest.cache, addr, &data);
+    hier_count_access(HIER_L1D, addr, width);
     dmem_status = READY;
     return data;
 }
@@ -237,6 +343,7 @@ uint64_t _mem_read_cache(const uint64_t addr, const unsigned width) {
 write_ret_code_t _mem_write_cache(const uint64_t addr, const uint64_t data, const unsigned width) {
     if (is_special_addr(addr))
         return _mem_write_special(addr, data, width);
+    _mem_check_access(addr, width, PROT_W);
 
     // byte_order_t b = get_byte_order(addr);
 
@@ -248,7 +355,7 @@ write_ret_code_t _mem_write_cache(const uint64_t addr, const uint64_t data, cons
             uword_t block_address = current_address & ~(B-1);
             if(inflight_addr != block_address || !inflight) {
                 inflight_addr = block_address;
-                inflight_cycles = guest.cache->d;
+                inflight_cycles = hier_latency(HIER_L1D, block_address, &inflight_cause);
                 inflight = true;
             }
 
@@ -259,31 +366,82 @@ write_ret_code_t _mem_write_cache(const uint64_t addr, const uint64_t data, cons
             }
 
             inflight = false;
-
-            uint8_t *block = calloc(B, 1);
-            for (int j = 0; j < B; j++) {
-                block[j] = _mem_read_LE(addr+j, 1);
-            }
-
-            evicted_line_t *evicted = handle_miss(guest.cache, block_address, WRITE, block);
-
-            if (evicted->valid && evicted->dirty) {
-                for (int j = 0; j < B; j++) {
-                    _mem_write_LE(evicted->addr+j, evicted->data[j], 1);
-                }
-            }
-
-            free(block);
-            free(evicted->data);
-            free(evicted);
+            hier_fill(HIER_L1D, block_address, WRITE);
         }
         current_address++;
     }
     set_word_cache(guest.cache, addr, data);
+    hier_count_access(HIER_L1D, addr, width);
     dmem_status = READY;
     return WRITE_SUCCESS;
 }
 
+/*
+ * Look up the instruction at addr in the L1I, as fetch does every cycle.
+ * imem_status says whether the block is there yet; a miss is retried in
+ * the cycles that follow until its latency has passed, as in the L1D. A
+ * fetch elsewhere starts over. Without an L1I, fetch always completes.
+ */
+
+void mem_fetch(const uint64_t addr) {
+    cache_t *l1i = hier_l1i();
+    imem_status = READY;
+    if (l1i == NULL || is_special_addr(addr) || check_hit(l1i, addr, READ))
+        return;
+
+    uword_t block_address = addr & ~((1UL << l1i->b) - 1);
+    if (ifetch_addr != block_address || !ifetch_inflight) {
+        perf_cause_t level;
+        ifetch_addr = block_address;
+        ifetch_cycles = hier_latency(HIER_L1I, block_address, &level);
+        ifetch_inflight = true;
+    }
+
+    ifetch_cycles--;
+    if (ifetch_cycles > 0) {
+        imem_status = IN_FLIGHT;
+        return;
+    }
+
+    ifetch_inflight = false;
+    hier_fill(HIER_L1I, block_address, READ);
+}
+
+/*
+ * Cycles left until the data cache miss in flight completes, counting the
+ * cycle in which it does. 0 if no miss is in flight.
+ */
+
+uint64_t mem_inflight_cycles(void) {
+    return (dmem_status == IN_FLIGHT) ? inflight_cycles : 0;
+}
+
+// The same for the L1I miss in flight.
+uint64_t mem_fetch_cycles(void) {
+    return (imem_status == IN_FLIGHT) ? ifetch_cycles : 0;
+}
+
+/*
+ * Let n cycles of the miss in flight pass with no access made, as if it
+ * had been retried in each. The cycle in which it completes must remain.
+ */
+
+void mem_skip_inflight(const uint64_t n) {
+    assert(n < inflight_cycles);
+    inflight_cycles -= n;
+}
+
+// The same for the L1I miss in flight.
+void mem_skip_fetch(const uint64_t n) {
+    assert(n < ifetch_cycles);
+    ifetch_cycles -= n;
+}
+
+// The level that will supply the block of the data cache miss in flight.
+perf_cause_t mem_inflight_cause(void) {
+    return inflight_cause;
+}
+
 char      mem_read_B (const uint64_t addr) {return (char)      _mem_read_cache(addr, 1);}
 short     mem_read_S (const uint64_t addr) {return (short)     _mem_read_cache(addr, 2);}
 int       mem_read_I (const uint64_t addr) {return (int)       _mem_read(addr, 4);}
@@ -308,4 +466,12 @@ write_ret_code_t mem_write_S (const uint64_t addr, const short     data) {return
 write_ret_code_t mem_write_I (const uint64_t addr, const int       data) {return _mem_write(addr, (uint64_t) data, 4);}
 write_ret_code_t mem_write_L (const uint64_t addr, const long      data) {return _mem_write(addr, (uint64_t) data, 8);}
 write_ret_code_t mem_write_LL(const uint64_t addr, const long long data) {return _mem_write(addr, (uint64_t) data, 8);}
+
+// Without the cache, every access completes in the cycle it is made.
+void mem_fetch(const uint64_t addr) {}
+uint64_t mem_inflight_cycles(void) {return 0;}
+uint64_t mem_fetch_cycles(void) {return 0;}
+void mem_skip_inflight(const uint64_t n) {assert(n == 0);}
+void mem_skip_fetch(const uint64_t n) {assert(n == 0);}
+perf_cause_t mem_inflight_cause(void) {return CPI_MEM;}
 #endif
\ No newline at end of file
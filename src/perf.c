@@ -0,0 +1,57 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * perf.c - Performance counters of the pipeline. proc.c counts cycles and
+ * retired instructions, and charges each cycle that retires nothing to
+ * the hazard or memory stall behind it. The counters are printed as a CPI
+ * stack at exit.
+ **************************************************************************/
+
+#include "archsim.h"
+
+extern machine_t guest;
+
+static const char *cause_names[CPI_CAUSES] = {
+    [CPI_LOAD_USE] = "load-use",
+    [CPI_MISPREDICT] = "mispredict",
+    [CPI_MISFETCH] = "BTB miss",
+    [CPI_RET] = "RET bubble",
+    [CPI_L2] = "L2",
+    [CPI_L3] = "L3",
+    [CPI_MEM] = "memory",
+    [CPI_ICACHE] = "L1I miss",
+    [CPI_FILL] = "fill/drain",
+};
+
+const perf_counters_t *perf_get(void) {
+    return &guest.proc->perf;
+}
+
+void perf_reset(void) {
+    memset(&guest.proc->perf, 0, sizeof(perf_counters_t));
+}
+
+double perf_cpi(void) {
+    const perf_counters_t *p = &guest.proc->perf;
+    return p->retired ? (double) p->cycles / p->retired : 0.0;
+}
+
+/* Each component is the cycles charged to it per retired instruction,
+ * so the components sum to the CPI. The base is 1, one retiring cycle per
+ * instruction. A sampled run only counts the detailed intervals (warm-up,
+ * sample and drain), so its stack is labelled as such.
+ */
+void perf_print(FILE *f) {
+    const perf_counters_t *p = &guest.proc->perf;
+    if (p->retired == 0)
+        return;
+    double n = p->retired;
+    fprintf(f, "%s: %lu cycles, %lu instructions retired, CPI %.4f\n",
+            sample_period ? "CPI stack of the detailed intervals" : "CPI stack",
+            p->cycles, p->retired, perf_cpi());
+    fprintf(f, "  %-12s %8.4f %12lu\n", "base", 1.0, p->retired);
+    for (int i = 0; i < CPI_CAUSES; i++) {
+        if (p->lost[i])
+            fprintf(f, "  %-12s %8.4f %12lu\n", cause_names[i], p->lost[i] / n, p->lost[i]);
+    }
+}
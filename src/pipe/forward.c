@@ -0,0 +1,43 @@
+#include "machine.h"
+#include "forward.h"
+
+/* Data forwarding logic.
+ *
+ * forward_reg is called from the decode stage after the register file
+ * has been read. Any later stage that will write one of D's source
+ * registers overrides the value read from the register file. The checks
+ * run from oldest (W) to youngest (X) so the youngest producer wins.
+ */
+
+extern machine_t guest;
+
+void forward_reg(uint8_t D_src1, uint8_t D_src2, uint8_t X_dst, uint8_t M_dst, uint8_t W_dst,
+                 uint64_t X_val_ex, uint64_t M_val_ex, uint64_t M_val_mem, uint64_t W_val_ex,
+                 uint64_t W_val_mem, bool M_wval_sel, bool W_wval_sel, uint64_t *val_a, uint64_t *val_b) {
+    if (guest.proc->w_insn->in->W_sigs.w_enable) {
+        if (W_dst == D_src1) {
+            *val_a = W_wval_sel ? W_val_mem : W_val_ex;
+            if (guest.proc->w_insn->in->W_sigs.dst_sel)
+                *val_a = guest.proc->w_insn->in->seq_succ_PC;
+        }
+        if (W_dst == D_src2) {
+            *val_b = W_wval_sel ? W_val_mem : W_val_ex;
+            if (guest.proc->w_insn->in->W_sigs.dst_sel)
+                *val_b = guest.proc->w_insn->in->seq_succ_PC;
+        }
+    }
+
+    if (guest.proc->m_insn->in->W_sigs.w_enable) {
+        if (M_dst == D_src1)
+            *val_a = M_wval_sel ? M_val_mem : M_val_ex;
+        if (M_dst == D_src2)
+            *val_b = M_wval_sel ? M_val_mem : M_val_ex;
+    }
+
+    if (guest.proc->x_insn->in->W_sigs.w_enable) {
+        if (X_dst == D_src1)
+            *val_a = X_val_ex;
+        if (X_dst == D_src2)
+            *val_b = X_val_ex;
+    }
+}
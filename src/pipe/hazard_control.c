@@ -13,15 +13,19 @@
 
 extern machine_t guest;
 extern mem_status_t dmem_status;
+extern mem_status_t imem_status;
 
+/* Why the output of each stage was last bubbled, indexed by
+ * proc_stage_t. Read by proc.c to charge the lost cycle.
+ */
+perf_cause_t bubble_cause[S_WBACK+1];
+
+/* Only outputs carry these flags. An input is either an output passed on
+ * without them, or the bubble instruction that proc.c shares between
+ * every register, which must not be written.
+ */
 void reset_stall()
 {
-    guest.proc->w_insn->in->stall = 0;
-    guest.proc->m_insn->in->stall = 0;
-    guest.proc->x_insn->in->stall = 0;
-    guest.proc->d_insn->in->stall = 0;
-    guest.proc->f_insn->in->stall = 0;
-
     guest.proc->w_insn->out->stall = 0;
     guest.proc->m_insn->out->stall = 0;
     guest.proc->x_insn->out->stall = 0;
@@ -31,12 +35,6 @@ void reset_stall()
 
 void reset_bubble()
 {
-    guest.proc->w_insn->in->bubble = 0;
-    guest.proc->m_insn->in->bubble = 0;
-    guest.proc->x_insn->in->bubble = 0;
-    guest.proc->d_insn->in->bubble = 0;
-    guest.proc->f_insn->in->bubble = 0;
-
     guest.proc->w_insn->out->bubble = 0;
     guest.proc->m_insn->out->bubble = 0;
     guest.proc->x_insn->out->bubble = 0;
@@ -55,12 +53,18 @@ bool check_load_use_hazard(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2,
     return (X_opcode == OP_LDURB || X_opcode == OP_LDUR) && ((X_dst == D_src1) ||(X_dst == D_src2));
 }
 
-bool check_mispred_branch_hazard(opcode_t X_opcode, bool X_condval) {
-    return (X_opcode == OP_B_COND)&& !X_condval;
+bool check_mispred_branch_hazard(opcode_t X_opcode, bool X_condval, bool X_pred_taken) {
+    return (X_opcode == OP_B_COND) && X_condval != X_pred_taken;
 }
 
-bool check_ret_hazard(opcode_t D_opcode) {
-    return D_opcode == OP_RET; // && dmem_status
+// A RET whose target the RAS did not supply, or got wrong.
+bool check_ret_hazard(opcode_t D_opcode, bool D_pred_taken, uint64_t D_target, uint64_t D_val_a) {
+    return D_opcode == OP_RET && !(D_pred_taken && D_target == D_val_a);
+}
+
+// A B or BL that missed in the BTB, so F fetched past it.
+bool check_misfetch_hazard(opcode_t D_opcode, bool D_pred_taken) {
+    return (D_opcode == OP_B || D_opcode == OP_BL) && !D_pred_taken;
 }
 
 comb_logic_t handle_hazards(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2, 
@@ -71,21 +75,34 @@ comb_logic_t handle_hazards(opcode_t D_opcode, uint8_t D_src1, uint8_t D_src2,
         reset();
         guest.proc->f_insn->out->stall = 1;
         guest.proc->d_insn->out->bubble = 1;
+        bubble_cause[S_DECODE] = CPI_LOAD_USE;
         // guest.proc->x_insn->out->bubble = 1;
     }
     // reset();
-    if (check_mispred_branch_hazard(X_opcode, X_condval))
+    bool mispred = check_mispred_branch_hazard(X_opcode, X_condval, guest.proc->x_insn->in->pred_taken);
+    if (mispred)
     {
         reset();
         guest.proc->d_insn->out->bubble = 1;
         guest.proc->x_insn->out->bubble = 1;
+        bubble_cause[S_DECODE] = CPI_MISPREDICT;
+        bubble_cause[S_EXECUTE] = CPI_MISPREDICT;
+    }
+    // F is waiting on an L1I miss.
+    if (imem_status == IN_FLIGHT && !guest.proc->f_insn->out->stall)
+    {
+        guest.proc->f_insn->out->bubble = 1;
+        bubble_cause[S_FETCH] = CPI_ICACHE;
     }
     // reset();
-    // somethings probably wrong w this case
-    if (check_ret_hazard(D_opcode))
+    // A RET or misfetched branch in D is on the wrong path after a mispredict.
+    instr_impl_t *D_out = guest.proc->d_insn->out;
+    if (!mispred && (check_ret_hazard(D_opcode, D_out->pred_taken, D_out->target_PC, D_out->val_a) ||
+                     check_misfetch_hazard(D_opcode, D_out->pred_taken)))
     {
         reset();
         guest.proc->f_insn->out->bubble = 1;
+        bubble_cause[S_FETCH] = (D_opcode == OP_RET) ? CPI_RET : CPI_MISFETCH;
     }
 
     if (dmem_status == IN_FLIGHT) {
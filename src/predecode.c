@@ -0,0 +1,67 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * predecode.c - Module for a direct-mapped cache of decoded instructions,
+ * so that a loop body is fetched from guest memory and decoded only once.
+ *
+ * A page holding cached instructions is marked in its PTE. A store to a
+ * marked page drops every entry from that page before it is written.
+ **************************************************************************/
+
+#include <stddef.h>
+#include "predecode.h"
+#include "ptable.h"
+#include "tlb.h"
+
+static predecode_entry_t predecode[PREDECODE_SIZE];
+
+static inline unsigned predecode_index(const uint64_t PC) {
+    return (PC >> 2) % PREDECODE_SIZE;
+}
+
+predecode_ptr_t predecode_lookup(const uint64_t PC) {
+    predecode_ptr_t pd = &predecode[predecode_index(PC)];
+    if (pd->pd_valid && PC == pd->pd_PC) return pd;
+    return NULL;
+}
+
+/* Special addresses such as RET_FROM_MAIN_ADDR have no page to mark; no
+ * store can reach them either.
+ */
+predecode_ptr_t predecode_fill(const uint64_t PC, const uint32_t insnbits, const opcode_t op) {
+    predecode_ptr_t pd = &predecode[predecode_index(PC)];
+    pd->pd_valid = true;
+    pd->pd_PC = PC;
+    pd->pd_insnbits = insnbits;
+    pd->pd_op = op;
+    pd->pd_decoded = false;
+
+    pte_ptr_t page = get_page(PC / PAGESIZE);
+    if (NULL != page && !page->p_code) {
+        page->p_code = true;
+        tlb_invalidate(page->p_num);
+    }
+    return pd;
+}
+
+/* A page's instructions occupy one contiguous run of slots, so only that
+ * run needs to be checked.
+ */
+void predecode_invalidate_page(const uint64_t pnum) {
+    uint64_t PC = pnum * PAGESIZE;
+    for (int i = 0; i < PAGESIZE / 4 && i < PREDECODE_SIZE; i++, PC += 4) {
+        predecode_ptr_t pd = &predecode[predecode_index(PC)];
+        if (pd->pd_PC / PAGESIZE == pnum) pd->pd_valid = false;
+    }
+
+    pte_ptr_t page = get_page(pnum);
+    if (NULL != page) {
+        page->p_code = false;
+        tlb_invalidate(pnum);
+    }
+}
+
+void predecode_flush(void) {
+    for (int i = 0; i < PREDECODE_SIZE; i++)
+        predecode[i].pd_valid = false;
+}
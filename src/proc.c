@@ -11,6 +11,12 @@
 
 #include "archsim.h"
 #include "hw_elts.h"
+#include "ptable.h"
+#include "console.h"
+#include "sample.h"
+#include "trace.h"
+#include "bpred.h"
+#include "hier.h"
 #include "pipe/hazard_control.h"
 
 #define F_insn_in guest.proc->f_insn->in
@@ -27,96 +33,290 @@
 uint64_t pred_pc;
 uint64_t current_PC;
 
+static char printbuf[BUF_LEN];
+
 extern machine_t guest;
 extern bool X_condval;
 
+/* Bubble instruction for hazard handling. It is shared by every pipeline
+ * register that holds a bubble, and is never written.
+ */
+static instr_impl_t *bubble_insn;
+
+static pipe_reg_t **pipes[5];
+
+/* Each pipeline register owns two slots, and the registers pass them
+ * along by pointer. While a register's in points at bubble_insn, its own
+ * second slot is parked here.
+ */
+static instr_impl_t *spare[5];
+
+/* While the input of stage i holds a bubble, in_cause[i] is why it was
+ * inserted. When the bubble reaches the end of X, the cycle in which
+ * nothing retires is charged to that cause.
+ */
+static perf_cause_t in_cause[5];
+
+/* Move the output of stage i into the input of stage i+1 by swapping
+ * pointers: stage i+1 has consumed its input slot, so that slot becomes
+ * stage i's next output. A bubbled output is dropped and stage i+1 reads
+ * bubble_insn instead.
+ */
+static void advance(const int i) {
+    pipe_reg_t *from = *pipes[i], *to = *pipes[i+1];
+    if (from->out->bubble) {
+        from->out->bubble = false;
+        if (to->in != bubble_insn) {
+            spare[i+1] = to->in;
+            to->in = bubble_insn;
+        }
+        return;
+    }
+    instr_impl_t *freed = (to->in == bubble_insn) ? spare[i+1] : to->in;
+    to->in = from->out;
+    from->out = freed;
+}
+
+static bool pipe_empty(void) {
+    for (int i = 1; i < 5; i++) {
+        if ((*pipes[i])->in->seq_succ_PC != 0)
+            return false;
+    }
+    return true;
+}
+
+/* Fill every pipeline register with a bubble, so that the first PC
+ * selected is the architectural PC. Used at startup and when the pipeline
+ * takes over from the functional model.
+ */
+void reset_pipeline(void) {
+    for (int i = 0; i < 5; i++) {
+        if ((*pipes[i])->in == bubble_insn)
+            (*pipes[i])->in = spare[i];
+        memcpy((*pipes[i])->in, bubble_insn, sizeof(instr_impl_t));
+        memcpy((*pipes[i])->out, bubble_insn, sizeof(instr_impl_t));
+        in_cause[i] = CPI_FILL;
+    }
+    X_condval = false;
+
+    /* Will be selected as the first PC */
+    pred_pc = guest.proc->PC.bits->xval;
+}
+
+/* Run one clock cycle of the pipeline. While draining, nothing new is
+ * fetched, and the PC is held at the next instruction the functional model
+ * must run. Returns true once main has returned.
+ */
+static bool step_pipeline(const bool drain, const uint64_t stop_PC, bool *at_stop,
+                          uint64_t *num_cycles, uint64_t *num_retired) {
+    if (!guest.proc->f_insn->out->stall) {
+        guest.proc->f_insn->in->pred_PC = pred_pc;
+    }
+    
+    /* Run each stage */
+    wback_instr(guest.proc->w_insn);
+    memory_instr(guest.proc->m_insn);
+    execute_instr(guest.proc->x_insn);   
+    decode_instr(guest.proc->d_insn);   
+    fetch_instr(guest.proc->f_insn);
+
+    /* Check for hazards and appropriately stall/bubble stages */
+    uint8_t D_src1 = (D_insn_in->op == OP_MOVZ) ? 0x1F : GETBF(D_insn_in->insnbits, 5, 5);
+    uint8_t D_src2 = (D_insn_in->op != OP_STUR) ? GETBF(D_insn_in->insnbits, 16, 5) : GETBF(D_insn_in->insnbits, 0, 5);
+    uint8_t X_dst = X_insn_in->W_sigs.dst_sel ? 30 : X_insn_in->dst;
+
+    handle_hazards(D_insn_out->op, D_src1, D_src2, X_insn_in->op, X_dst, X_condval);
+
+    if (drain && !guest.proc->f_insn->out->stall) {
+        guest.proc->f_insn->out->bubble = true;
+        bubble_cause[S_FETCH] = CPI_FILL;
+        pred_pc = current_PC;
+    }
+
+    /* Trace the pipeline state for -v and -T */
+    TRACE_CYCLE(*num_cycles);
+
+    /* Stall checking */
+    if (!guest.proc->f_insn->out->stall) {
+        guest.proc->PC.bits->xval = pred_pc;
+    }
+
+    /* Main has returned once its RET has been decoded. */
+    bool main_returned = !D_insn_out->bubble && D_insn_out->op == OP_RET &&
+                         D_insn_out->val_a == RET_FROM_MAIN_ADDR;
+
+    /* A bubbled output carries the hazard that bubbled it, and any other
+     * output carries the cause of the bubble (if any) its stage consumed.
+     */
+    perf_cause_t out_cause[4];
+    for (int i = 0; i < 4; i++)
+        out_cause[i] = (*pipes[i])->out->bubble ? bubble_cause[i] : in_cause[i];
+
+    perf_counters_t *perf = &guest.proc->perf;
+
+    /* Cycle instructions */
+    for (int i = 0; i < 4; i++) {
+        pipe_reg_t *pipe = *pipes[i];
+        /* Can only stall, bubble, or neither, not both */
+        if (pipe->out->stall && pipe->out->bubble) {
+            logging(LOG_ERROR, "An instruction was both bubbled and stalled.");
+        }
+        /* An instruction retires as it leaves execute, where its outcome is
+         * known. A mispredicted B.cond is bubbled out of X, so count it
+         * first. Bubbles have no successor PC.
+         */
+        if (i == 2 && !pipe->out->stall && pipe->out->seq_succ_PC != 0) {
+            (*num_retired)++;
+            perf->retired++;
+            if (bbv_file != NULL)
+                bbv_retire(pipe->out->seq_succ_PC - 4, pipe->out->op);
+            if (stop_PC && pipe->out->seq_succ_PC - 4 == stop_PC)
+                *at_stop = true;
+            if (pipe->out->op == OP_B || pipe->out->op == OP_B_COND ||
+                pipe->out->op == OP_BL || pipe->out->op == OP_RET)
+                bpred_resolve(pipe->out, pipe->out->op != OP_B_COND || X_condval);
+        } else if (i == 2) {
+            /* X only stalls behind a data cache miss */
+            perf->lost[pipe->out->stall ? mem_inflight_cause() : out_cause[2]]++;
+        }
+        if (i == 0 && !pipe->out->stall && !pipe->out->bubble)
+            hier_count_access(HIER_L1I, pipe->out->seq_succ_PC - 4, 4);
+        /* A stalled stage keeps its input, so nothing moves */
+        if (!pipe->out->stall) {
+            advance(i);
+            in_cause[i+1] = out_cause[i];
+        }
+    }
+
+    (*num_cycles)++;
+    perf->cycles++;
+    return main_returned;
+}
+
+/* While a data cache miss is in flight, F, D, X and M stay stalled, and
+ * every cycle before the one in which it completes repeats the same work.
+ * So does every cycle of an L1I miss, once the bubbles it sends down have
+ * emptied the pipeline behind F. Jump the clock to the first cycle in
+ * which a miss completes, but not past stop_cycles (0 for no limit). A
+ * traced run steps through each cycle.
+ */
+static void skip_stall_cycles(const uint64_t stop_cycles, uint64_t *num_cycles) {
+    uint64_t n = mem_inflight_cycles();
+    uint64_t f = mem_fetch_cycles();
+    perf_cause_t cause = mem_inflight_cause();
+    if (n == 0) {
+        if (f == 0 || !pipe_empty() || in_cause[1] != CPI_ICACHE || in_cause[2] != CPI_ICACHE)
+            return;
+        n = f;
+        cause = CPI_ICACHE;
+    } else if (f != 0 && f < n) {
+        n = f;
+    }
+    if (n <= 1 || TRACE_ACTIVE)
+        return;
+    n--;
+    if (stop_cycles && *num_cycles + n > stop_cycles)
+        n = stop_cycles - *num_cycles;
+    if (mem_inflight_cycles())
+        mem_skip_inflight(n);
+    if (f)
+        mem_skip_fetch(n);
+    *num_cycles += n;
+    guest.proc->perf.cycles += n;
+    guest.proc->perf.lost[cause] += n;
+}
+
+/* Run the pipeline until retire_limit more instructions have retired,
+ * cycle_limit cycles have elapsed, or the instruction at stop_PC has
+ * retired (0 for no limit on any of them), or main returns. The counters
+ * are accumulated into. Returns true if main returned.
+ */
+bool run_pipeline(const uint64_t retire_limit, const uint64_t cycle_limit, const uint64_t stop_PC,
+                  uint64_t *num_cycles, uint64_t *num_retired) {
+    uint64_t stop_retired = *num_retired + retire_limit;
+    uint64_t stop_cycles = *num_cycles + cycle_limit;
+    bool at_stop = false;
+    do {
+        if (step_pipeline(false, stop_PC, &at_stop, num_cycles, num_retired))
+            return true;
+        skip_stall_cycles(cycle_limit ? stop_cycles : 0, num_cycles);
+    } while (!(retire_limit && *num_retired >= stop_retired) &&
+             !(cycle_limit && *num_cycles >= stop_cycles) && !at_stop);
+    return false;
+}
+
+/* Stop fetching and run until every instruction in flight has completed,
+ * leaving the architectural state and PC ready for the functional model.
+ * Returns true if main returned.
+ */
+bool drain_pipeline(uint64_t *num_cycles, uint64_t *num_retired) {
+    bool at_stop = false;
+    do {
+        if (step_pipeline(true, 0, &at_stop, num_cycles, num_retired))
+            return true;
+        skip_stall_cycles(0, num_cycles);
+    } while (!pipe_empty());
+    return false;
+}
+
 int runElf(const uint64_t entry) {
     logging(LOG_INFO, "Running ELF executable");
     guest.proc->PC.bits->xval = entry;
     guest.proc->SP.bits->xval = guest.mem->seg_start_addr[KERNEL_SEG]-8;
+    /* The startup frame above the initial SP (argc/argv/envp on a real system)
+     * spills into the kernel segment, so leave its first page user-readable.
+     */
+    mem_map(guest.mem->seg_start_addr[KERNEL_SEG], PAGESIZE, PROT_R);
     guest.proc->NZCV.bits->ccval = PACK_CC(0, 1, 0, 0);
     guest.proc->GPR.bits[30].xval = RET_FROM_MAIN_ADDR;
+    guest.mode = MODE_USER; // Page protection is enforced from here on.
 
-    /* Bubble instructions for hazard handling */
-    instr_impl_t *bubble_insn = calloc(1, sizeof(instr_impl_t));
+    bubble_insn = calloc(1, sizeof(instr_impl_t));
     bubble_insn->op = OP_NOP;
     bubble_insn->insnbits = 0xd503201f;
 
-    pipe_reg_t **pipes[] = {&guest.proc->f_insn, &guest.proc->d_insn, &guest.proc->x_insn,
-                           &guest.proc->m_insn, &guest.proc->w_insn};
-
+    pipes[0] = &guest.proc->f_insn;
+    pipes[1] = &guest.proc->d_insn;
+    pipes[2] = &guest.proc->x_insn;
+    pipes[3] = &guest.proc->m_insn;
+    pipes[4] = &guest.proc->w_insn;
+    /* All ten slots are allocated together so they share a few cache lines */
+    instr_impl_t *slots = calloc(10, sizeof(instr_impl_t));
     for (int i = 0; i < 5; i++) {
         *pipes[i] = (pipe_reg_t *)calloc(1, sizeof(pipe_reg_t));
-        (*pipes[i])->in = (instr_impl_t *)calloc(1, sizeof(instr_impl_t));
-        (*pipes[i])->out = (instr_impl_t *)calloc(1, sizeof(instr_impl_t));
-        memcpy((*pipes[i])->in, bubble_insn, sizeof(instr_impl_t));
-        memcpy((*pipes[i])->out, bubble_insn, sizeof(instr_impl_t));
+        (*pipes[i])->in = &slots[2*i];
+        (*pipes[i])->out = &slots[2*i+1];
     }
 
-    /* Will be selected as the first PC */
-    pred_pc = guest.proc->PC.bits->xval;
-
-#ifdef DEBUG
-    printf("\n%s%s   Addr      Instr       Op  \tCond\tDest\tSrc1\tSrc2\tImmval   \t\tShift%s\n", 
-           ANSI_BOLD, ANSI_COLOR_RED, ANSI_RESET);
-#endif
-    unsigned int num_instr = 0;
-    do {
-        if (!guest.proc->f_insn->out->stall) {
-            guest.proc->f_insn->in->pred_PC = pred_pc;
-        }
-        
-        /* Run each stage */
-        wback_instr(guest.proc->w_insn);
-        memory_instr(guest.proc->m_insn);
-        execute_instr(guest.proc->x_insn);   
-        decode_instr(guest.proc->d_insn);   
-        fetch_instr(guest.proc->f_insn);
-
-        /* Check for hazards and appropriately stall/bubble stages */
-        uint8_t D_src1 = (D_insn_in->op == OP_MOVZ) ? 0x1F : GETBF(D_insn_in->insnbits, 5, 5);
-        uint8_t D_src2 = (D_insn_in->op != OP_STUR) ? GETBF(D_insn_in->insnbits, 16, 5) : GETBF(D_insn_in->insnbits, 0, 5);
-        uint8_t X_dst = X_insn_in->W_sigs.dst_sel ? 30 : X_insn_in->dst;
-    
-        handle_hazards(D_insn_out->op, D_src1, D_src2, X_insn_in->op, X_dst, X_condval);
-
-        /* Print debug output */
-        if(debug_level > 0)
-            printf("\nPipeline state at end of cycle %d:\n", num_instr);
-        show_instr(guest.proc->f_insn->out, S_FETCH, debug_level);
-        show_instr(guest.proc->d_insn->out, S_DECODE, debug_level);
-        show_instr(guest.proc->x_insn->out, S_EXECUTE, debug_level);
-        show_instr(guest.proc->m_insn->out, S_MEMORY, debug_level);
-        show_instr(guest.proc->w_insn->out, S_WBACK, debug_level);
-        if(debug_level > 0)
-            printf("\n\n");
-
-        /* Stall checking */
-        if (!guest.proc->f_insn->out->stall) {
-            guest.proc->PC.bits->xval = pred_pc;
-        }
+    if (sample_period) {
+        runSampled();
+        free(bubble_insn);
+        console_flush();
+        return EXIT_SUCCESS;
+    }
 
-        /* Cycle instructions */
-        for (int i = 0; i < 4; i++) {
-            pipe_reg_t *pipe = *pipes[i];
-            /* Can only stall, bubble, or neither, not both */
-            if (pipe->out->stall && pipe->out->bubble) {
-                logging(LOG_ERROR, "An instruction was both bubbled and stalled.");
-            }
-            /* Insert bubbles if needed */
-            if (pipe->out->bubble) {
-                memcpy(pipe->out, bubble_insn, sizeof(instr_impl_t));
-            }
-            /* Copy output of one stage to the next stage's input */
-            if (!pipe->out->stall) {
-                memcpy((*pipes[i+1])->in, pipe->out, sizeof(instr_impl_t));
-            }
+    if (functional_only || ff_instr || ff_PC) {
+        uint64_t num_ff;
+        bool done = runFunctional(functional_only ? max_retired : ff_instr,
+                                  functional_only ? stop_PC : ff_PC, &num_ff);
+        sprintf(printbuf, "Functional model retired %lu instructions, stopping at PC 0x%lx",
+                num_ff, guest.proc->PC.bits->xval);
+        logging(LOG_INFO, printbuf);
+        if (done || functional_only) {
+            free(bubble_insn);
+            console_flush();
+            return EXIT_SUCCESS;
         }
+    }
+    reset_pipeline();
 
-        /* Writeback - do we need it or is it for students? */
-
-        num_instr++;
-    } while (!(D_insn_out->op == OP_RET && D_insn_out->val_a == RET_FROM_MAIN_ADDR) && num_instr < MAX_NUM_INSTR);
+    uint64_t num_cycles = 0, num_retired = 0;
+    if (!run_pipeline(max_retired, max_cycles, stop_PC, &num_cycles, &num_retired)) {
+        sprintf(printbuf, "Stopped after %lu cycles, %lu instructions retired",
+                num_cycles, num_retired);
+        logging(LOG_INFO, printbuf);
+    }
     free(bubble_insn);
+    console_flush();
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -5,45 +5,137 @@
  * 
  * ptable.c - Module for simple demand-paged virtual memory.
  * 
+ * The page table is a 4-level radix tree indexed by the 52-bit page number,
+ * 13 bits per level. Interior nodes are allocated on demand, so the sparse
+ * TEXT/DATA/HEAP/STACK layout only touches a handful of nodes.
+ * 
+ * Page frames, radix nodes and PTEs are carved out of large anonymous
+ * mappings by bump allocation, so the whole guest address space can be
+ * released in one pass over those mappings by free_ptable().
+ * 
  * Copyright (c) 2022. S. Chatterjee. All rights reserved.
  * May not be used, modified, or copied without permission.
  **************************************************************************/ 
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include "ptable.h"
+#include "tlb.h"
+
+#define PT_LEVELS 4
+#define PT_BITS 13
+#define PT_FANOUT (1 << PT_BITS)
+#define PT_INDEX(pnum, level) (((pnum) >> ((PT_LEVELS-1-(level)) * PT_BITS)) & (PT_FANOUT-1))
+
+#define ARENA_CHUNK (2UL << 20)
+
+// A bump allocator over a list of ARENA_CHUNK-sized anonymous mappings.
+typedef struct arena_chunk {
+    char *c_base;
+    struct arena_chunk *c_next;
+} arena_chunk_t;
+
+typedef struct arena {
+    arena_chunk_t *a_chunks;
+    char *a_next;
+    char *a_end;
+} arena_t;
 
-#define HASHSIZE 128
-static pte_ptr_t ptable[HASHSIZE];
+static arena_t frame_arena; // Page frames and radix nodes, page-aligned.
+static arena_t pte_arena;
 
-static unsigned long ptable_hash(const uint64_t pnum) {
-    unsigned long h = 0, high;
-    char *s = (char *) &pnum;
+static void **ptable;
 
-    for (int i = 0; i < 7; i++) {
-        h = (h << 4) + *s++;
-        if ((high = h & 0xF0000000))
-            h ^= high >> 24;
-        h &= ~high;
+// Shared read-only backing for every page that has never been written.
+static char zero_page[PAGESIZE] __attribute__((aligned(PAGESIZE)));
+
+// Return size zero-filled bytes aligned to align, a power of two.
+static void *arena_alloc(arena_t *a, const size_t size, const size_t align) {
+    uintptr_t p = ((uintptr_t) a->a_next + align-1) & ~(uintptr_t) (align-1);
+    if (NULL == a->a_next || p + size > (uintptr_t) a->a_end) {
+        char *base = mmap(NULL, ARENA_CHUNK, PROT_READ | PROT_WRITE, 
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (MAP_FAILED == base) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t));
+        chunk->c_base = base;
+        chunk->c_next = a->a_chunks;
+        a->a_chunks = chunk;
+        a->a_end = base + ARENA_CHUNK;
+        p = (uintptr_t) base;
     }
-    return h % HASHSIZE;
+    a->a_next = (char *) (p + size);
+    return (void *) p;
 }
 
-pte_ptr_t get_page(const uint64_t pnum) {
-    unsigned long phash = ptable_hash(pnum);
-    pte_ptr_t p = ptable[phash];
-    for (; p != NULL; p = p->p_next) {
-        if (pnum == p->p_num) return p;
+static void arena_free(arena_t *a) {
+    while (NULL != a->a_chunks) {
+        arena_chunk_t *chunk = a->a_chunks;
+        munmap(chunk->c_base, ARENA_CHUNK);
+        a->a_chunks = chunk->c_next;
+        free(chunk);
     }
-    return p;
+    a->a_next = a->a_end = NULL;
+}
+
+static void **alloc_node(void) {
+    return arena_alloc(&frame_arena, PT_FANOUT * sizeof(void *), PAGESIZE);
+}
+
+pte_ptr_t get_page(const uint64_t pnum) {
+    void **node = ptable;
+    for (int l = 0; l < PT_LEVELS && NULL != node; l++)
+        node = (void **) node[PT_INDEX(pnum, l)];
+    return (pte_ptr_t) node;
 }
 
-pte_ptr_t add_page(const uint64_t num, const uint8_t prot) {
-    pte_ptr_t npage = malloc(sizeof(pte_t));
+static pte_ptr_t _add_page(const uint64_t num, const uint8_t prot, const byte_order_t order, char *data) {
+    if (NULL == ptable)
+        ptable = alloc_node();
+    void **node = ptable;
+    for (int l = 0; l < PT_LEVELS-1; l++) {
+        void **slot = &node[PT_INDEX(num, l)];
+        if (NULL == *slot)
+            *slot = alloc_node();
+        node = (void **) *slot;
+    }
+
+    pte_ptr_t npage = arena_alloc(&pte_arena, sizeof(pte_t), sizeof(void *));
     npage->p_num = num;
     npage->p_prot = prot;
-    npage->p_data = calloc(PAGESIZE,sizeof(char));
-    unsigned long phash = ptable_hash(num);
-    npage->p_next = ptable[phash];
-    ptable[phash] = npage;
+    npage->p_order = order;
+    npage->p_zero = (data == zero_page);
+    npage->p_code = false;
+    npage->p_data = data;
+    node[PT_INDEX(num, PT_LEVELS-1)] = npage;
+    tlb_invalidate(num);
     return npage;
-}
\ No newline at end of file
+}
+
+pte_ptr_t add_page(const uint64_t num, const uint8_t prot, const byte_order_t order) {
+    return _add_page(num, prot, order, arena_alloc(&frame_arena, PAGESIZE, PAGESIZE));
+}
+
+// Map a page that has only been read so far onto the shared zero page.
+pte_ptr_t add_zero_page(const uint64_t num, const uint8_t prot, const byte_order_t order) {
+    return _add_page(num, prot, order, zero_page);
+}
+
+// Give a page backed by the shared zero page private storage of its own.
+void cow_page(const pte_ptr_t page) {
+    if (!page->p_zero) return;
+    page->p_data = arena_alloc(&frame_arena, PAGESIZE, PAGESIZE);
+    page->p_zero = false;
+    tlb_invalidate(page->p_num);
+}
+
+// Release every page, PTE and radix node of the guest address space.
+void free_ptable(void) {
+    arena_free(&frame_arena);
+    arena_free(&pte_arena);
+    ptable = NULL;
+    tlb_flush();
+}
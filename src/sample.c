@@ -0,0 +1,126 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * sample.c - Sampled simulation in the style of SMARTS. The program runs
+ * in the functional model, which keeps the data cache warm, and every
+ * sampling period switches to the pipeline for a short detailed warmup
+ * followed by a measured unit. CPI is reported as a mean over the units
+ * with a confidence interval.
+ *
+ * Basic-block vectors in the SimPoint format can be written as well, one
+ * per sampling period, so that representative periods can be chosen in
+ * advance.
+ **************************************************************************/
+
+#include <math.h>
+#include "archsim.h"
+#include "console.h"
+#include "sample.h"
+
+extern machine_t guest;
+
+FILE *bbv_file;
+
+typedef struct bbv_entry {
+    uint64_t bb_PC;    // Address of the first instruction, 0 if the slot is free.
+    uint64_t bb_count; // Instructions retired in this block during the period.
+    unsigned bb_id;    // SimPoint block ids start at 1.
+} bbv_entry_t;
+
+static bbv_entry_t bbv[BBV_SIZE];
+static unsigned bbv_num_blocks;
+static uint64_t bb_start;
+static uint64_t bb_len;
+
+static void bbv_end_block(void) {
+    unsigned i = (bb_start >> 2) % BBV_SIZE;
+    while (bbv[i].bb_PC != 0 && bbv[i].bb_PC != bb_start)
+        i = (i + 1) % BBV_SIZE;
+    if (bbv[i].bb_PC == 0) {
+        if (++bbv_num_blocks == BBV_SIZE) {
+            logging(LOG_FATAL, "Too many basic blocks for BBV output");
+            exit(EXIT_FAILURE);
+        }
+        bbv[i].bb_PC = bb_start;
+        bbv[i].bb_id = bbv_num_blocks;
+    }
+    bbv[i].bb_count += bb_len;
+    bb_len = 0;
+}
+
+/* Count one retired instruction towards the current basic block. A block
+ * ends at any instruction that can change the flow of control.
+ */
+void bbv_retire(const uint64_t PC, const opcode_t op) {
+    if (bb_len == 0)
+        bb_start = PC;
+    bb_len++;
+    if (op == OP_B || op == OP_B_COND || op == OP_BL || op == OP_RET)
+        bbv_end_block();
+}
+
+/* Write the vector for the period just ended and start a new one. */
+void bbv_interval_end(void) {
+    if (bb_len != 0)
+        bbv_end_block();
+    fputc('T', bbv_file);
+    for (unsigned i = 0; i < BBV_SIZE; i++) {
+        if (bbv[i].bb_count != 0) {
+            fprintf(bbv_file, ":%u:%lu ", bbv[i].bb_id, bbv[i].bb_count);
+            bbv[i].bb_count = 0;
+        }
+    }
+    fputc('\n', bbv_file);
+}
+
+void runSampled(void) {
+    uint64_t num_samples = 0, num_instr = 0;
+    double sum_cpi = 0.0, sum_sq_cpi = 0.0;
+    uint64_t skip = (sample_period > sample_warm + sample_unit) ?
+                    sample_period - sample_warm - sample_unit : 0;
+    bool done = false;
+
+    while (!done) {
+        uint64_t n = 0, cycles = 0, retired = 0;
+        if (skip != 0) {
+            done = runFunctional(skip, 0, &n);
+            num_instr += n;
+            if (done) break;
+        }
+
+        reset_pipeline();
+        if (sample_warm != 0)
+            done = run_pipeline(sample_warm, 0, 0, &cycles, &retired);
+        if (!done) {
+            uint64_t start_cycles = cycles, start_retired = retired;
+            done = run_pipeline(sample_unit, 0, 0, &cycles, &retired);
+            if (!done) {
+                double cpi = (double) (cycles - start_cycles) / (retired - start_retired);
+                sum_cpi += cpi;
+                sum_sq_cpi += cpi * cpi;
+                num_samples++;
+                done = drain_pipeline(&cycles, &retired);
+            }
+        }
+        num_instr += retired;
+        if (bbv_file != NULL && !done)
+            bbv_interval_end();
+    }
+    if (bbv_file != NULL) {
+        bbv_interval_end();
+        fclose(bbv_file);
+    }
+    console_flush(); // The guest's output comes before the results.
+
+    fprintf(outfile, "Sampled simulation: %lu instructions, %lu samples of %lu instructions\n",
+            num_instr, num_samples, sample_unit);
+    if (num_samples == 0) {
+        fprintf(outfile, "No sample completed; lower the sampling period or unit size.\n");
+        return;
+    }
+    double mean = sum_cpi / num_samples;
+    double var = (num_samples > 1) ?
+                 (sum_sq_cpi - num_samples * mean * mean) / (num_samples - 1) : 0.0;
+    double half = (var > 0.0) ? 1.96 * sqrt(var / num_samples) : 0.0;
+    fprintf(outfile, "CPI %.4f +/- %.4f (95%% confidence)\n", mean, half);
+}
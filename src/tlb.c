@@ -0,0 +1,44 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * tlb.c - Module for a direct-mapped software TLB in front of the page
+ * table. Every guest memory access goes through here before get_page().
+ **************************************************************************/
+
+#include <stddef.h>
+#include "tlb.h"
+
+static tlb_entry_t tlb[TLB_SIZE];
+
+static inline unsigned tlb_index(const uint64_t pnum) {
+    return pnum % TLB_SIZE;
+}
+
+tlb_entry_ptr_t tlb_lookup(const uint64_t pnum) {
+    tlb_entry_ptr_t t = &tlb[tlb_index(pnum)];
+    if (t->t_valid && pnum == t->t_pnum) return t;
+    return NULL;
+}
+
+tlb_entry_ptr_t tlb_fill(const pte_ptr_t page) {
+    tlb_entry_ptr_t t = &tlb[tlb_index(page->p_num)];
+    t->t_valid = true;
+    t->t_pnum = page->p_num;
+    t->t_prot = page->p_prot;
+    t->t_order = page->p_order;
+    t->t_zero = page->p_zero;
+    t->t_code = page->p_code;
+    t->t_data = page->p_data;
+    return t;
+}
+
+// Must be called whenever the mapping for pnum is created or changed.
+void tlb_invalidate(const uint64_t pnum) {
+    tlb_entry_ptr_t t = &tlb[tlb_index(pnum)];
+    if (t->t_pnum == pnum) t->t_valid = false;
+}
+
+void tlb_flush(void) {
+    for (int i = 0; i < TLB_SIZE; i++)
+        tlb[i].t_valid = false;
+}
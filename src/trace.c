@@ -0,0 +1,126 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * trace.c - Capture of the pipeline state at the end of each cycle. A
+ * record is printed as text for -v, and appended to a binary trace file
+ * for -T. The file is written in large blocks straight to its descriptor,
+ * so a traced run does not go through stdio.
+ *
+ * Everything here is compiled only with -DTRACE.
+ **************************************************************************/
+
+#ifdef TRACE
+#include <fcntl.h>
+#include <unistd.h>
+#include "archsim.h"
+#include "console.h"
+#include "trace.h"
+
+extern machine_t guest;
+extern uint64_t pred_pc;
+extern bool X_condval;
+
+bool trace_on;
+
+static int trace_fd = -1;
+static trace_rec_t trace_buf[TRACE_BUFSIZE / sizeof(trace_rec_t)];
+static size_t trace_len; // Records in trace_buf.
+
+static void trace_write(const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = write(trace_fd, p, len);
+        if (n < 0) {
+            logging(LOG_FATAL, "failed to write trace file");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+static void trace_close(void) {
+    if (trace_fd < 0)
+        return;
+    trace_write(trace_buf, trace_len * sizeof(trace_rec_t));
+    trace_len = 0;
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+/*
+ * Start writing a binary trace to fileName. The buffer is written out
+ * when the program exits.
+ */
+
+bool trace_open(const char *fileName) {
+    if ((trace_fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return false;
+    trace_header_t th = { .th_rec_size = sizeof(trace_rec_t) };
+    memcpy(th.th_magic, TRACE_MAGIC, sizeof(th.th_magic));
+    trace_write(&th, sizeof(th));
+    atexit(trace_close);
+    trace_on = true;
+    return true;
+}
+
+static void capture(trace_stage_t *ts, const instr_impl_t *insn) {
+    ts->ts_seq_succ_PC = insn->seq_succ_PC;
+    ts->ts_val_a = insn->val_a;
+    ts->ts_val_b = insn->val_b;
+    ts->ts_val_imm = insn->val_imm;
+    ts->ts_val_ex = insn->val_ex;
+    ts->ts_val_mem = insn->val_mem;
+    ts->ts_insnbits = insn->insnbits;
+    ts->ts_flags = (insn->bubble ? TS_BUBBLE : 0) |
+                   (insn->stall ? TS_STALL : 0) |
+                   (insn->X_sigs.valb_sel ? TS_VALB_SEL : 0) |
+                   (insn->X_sigs.set_CC ? TS_SET_CC : 0) |
+                   (insn->M_sigs.dmem_read ? TS_DMEM_READ : 0) |
+                   (insn->M_sigs.dmem_write ? TS_DMEM_WRITE : 0) |
+                   (insn->W_sigs.dst_31isSP ? TS_DST_31ISSP : 0) |
+                   (insn->W_sigs.dst_sel ? TS_DST_SEL : 0) |
+                   (insn->W_sigs.wval_sel ? TS_WVAL_SEL : 0) |
+                   (insn->W_sigs.w_enable ? TS_W_ENABLE : 0);
+    ts->ts_op = insn->op;
+    ts->ts_ALU_op = insn->ALU_op;
+    ts->ts_cond = insn->cond;
+    ts->ts_dst = insn->dst;
+    ts->ts_hw = insn->val_hw;
+    ts->ts_pad = 0;
+}
+
+/*
+ * Record the output side of every pipeline register, after hazard
+ * handling and before the registers advance.
+ */
+
+void trace_cycle(const uint64_t cycle) {
+    trace_rec_t *tr, rec;
+
+    // Build the record in place when it fits, to save a copy.
+    if (trace_fd >= 0 && trace_len == sizeof(trace_buf) / sizeof(trace_rec_t)) {
+        trace_write(trace_buf, sizeof(trace_buf));
+        trace_len = 0;
+    }
+    tr = (trace_fd >= 0) ? &trace_buf[trace_len] : &rec;
+
+    tr->tr_cycle = cycle;
+    tr->tr_PC = guest.proc->PC.bits->xval;
+    tr->tr_pred_PC = pred_pc;
+    tr->tr_condval = X_condval;
+    memset(tr->tr_pad, 0, sizeof(tr->tr_pad));
+    capture(&tr->tr_stage[S_FETCH], guest.proc->f_insn->out);
+    capture(&tr->tr_stage[S_DECODE], guest.proc->d_insn->out);
+    capture(&tr->tr_stage[S_EXECUTE], guest.proc->x_insn->out);
+    capture(&tr->tr_stage[S_MEMORY], guest.proc->m_insn->out);
+    capture(&tr->tr_stage[S_WBACK], guest.proc->w_insn->out);
+
+    if (trace_fd >= 0)
+        trace_len++;
+    if (debug_level > 0) {
+        console_flush(); // Keep guest output in order with the trace.
+        trace_print(stdout, tr, debug_level);
+    }
+}
+#endif
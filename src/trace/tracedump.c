@@ -0,0 +1,87 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * tracedump.c - Print a binary pipeline trace written by se -T in the
+ * text format of se -v.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define RECS_PER_READ 4096
+
+static void printUsage(char *argv[]) {
+    printf("Usage: %s [-h] [-v level] [-c first] [-n count] <tracefile>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v level   Detail of each record, 1 or 2 as in se -v (default 2).\n");
+    printf("  -c first   Skip the cycles before this one.\n");
+    printf("  -n count   Print at most this many cycles.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int level = 2, c;
+    unsigned long first = 0, count = 0;
+
+    while ((c = getopt(argc, argv, "v:c:n:h")) != -1) {
+        switch (c) {
+        case 'v':
+            level = atoi(optarg);
+            break;
+        case 'c':
+            first = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || level < 1 || level > 2) {
+        printUsage(argv);
+        exit(1);
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[optind]);
+        exit(1);
+    }
+
+    trace_header_t th;
+    if (fread(&th, sizeof(th), 1, f) != 1 ||
+        memcmp(th.th_magic, TRACE_MAGIC, sizeof(th.th_magic)) != 0) {
+        fprintf(stderr, "%s: %s is not a pipeline trace\n", argv[0], argv[optind]);
+        exit(1);
+    }
+    if (th.th_rec_size != sizeof(trace_rec_t)) {
+        fprintf(stderr, "%s: %s has %u-byte records, expected %zu\n",
+                argv[0], argv[optind], th.th_rec_size, sizeof(trace_rec_t));
+        exit(1);
+    }
+
+    static trace_rec_t recs[RECS_PER_READ];
+    unsigned long printed = 0;
+    size_t n;
+    while ((n = fread(recs, sizeof(trace_rec_t), RECS_PER_READ, f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (recs[i].tr_cycle < first)
+                continue;
+            if (count && printed == count)
+                goto done;
+            trace_print(stdout, &recs[i], level);
+            printed++;
+        }
+    }
+done:
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**************************************************************************
+ * C S 429 architecture emulator
+ *
+ * trace_print.c - Text form of a pipeline trace record. This is the
+ * format printed by -v, and is shared by the simulator and tracedump, so
+ * it depends on nothing but the record itself.
+ **************************************************************************/
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "trace.h"
+
+#define NELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+static const char *opcode_names[] = {
+    "ERR ",
+    "LDURB ",
+    "LDUR ",
+    "STURB ",
+    "STUR ",
+    "MOVK ",
+    "MOVZ ",
+    "ADD ",
+    "ADDS ",
+    "SUBS ",
+    "MVN ",
+    "ORR ",
+    "EOR ",
+    "ANDS ",
+    "LSL ",
+    "LSR ",
+    "UBFM ",
+    "ASR ",
+    "B ",
+    "B.cond ",
+    "BL ",
+    "RET ",
+    "NOP ",
+    "HLT "
+};
+
+static const char *cond_names[] = {
+    "EQ", "NE", "CS", "CC", "MI", "PL", "VS", "VC",
+    "HI", "LS", "GE", "LT", "GT", "LE", "AL", "NV"
+};
+
+static const char *alu_op_names[] = {
+    "PLUS_OP",
+    "MINUS_OP",
+    "NEG_OP",
+    "OR_OP",
+    "EOR_OP",
+    "AND_OP",
+    "MOV_OP",
+    "LSL_OP",
+    "LSR_OP",
+    "ASR_OP",
+    "PASS_A_OP",
+    "PASS_B_OP"
+};
+
+// Error values are stored as 0xFF and print as the first name.
+#define NAME(names, i) ((i) < NELEMS(names) ? (names)[i] : (names)[0])
+
+#define TF(ts, bit) (((ts)->ts_flags & (bit)) ? "true" : "false")
+// Some columns pad true to the width of false.
+#define TF_(ts, bit) (((ts)->ts_flags & (bit)) ? "true " : "false")
+
+static void print_bubble_stall(FILE *f, const trace_stage_t *ts) {
+    fprintf(f, " \t [bubble, stall] = [%s, %s]\n", TF(ts, TS_BUBBLE), TF(ts, TS_STALL));
+}
+
+static void print_X_sigs(FILE *f, const trace_stage_t *ts) {
+    fprintf(f, "\t X_sigs: [valb_sel, set_CC] = [%s, %s]\n",
+            TF_(ts, TS_VALB_SEL), TF(ts, TS_SET_CC));
+}
+
+static void print_M_sigs(FILE *f, const trace_stage_t *ts) {
+    fprintf(f, "\t M_sigs: [dmem_read, dmem_write] = [%s, %s]\n",
+            TF_(ts, TS_DMEM_READ), TF(ts, TS_DMEM_WRITE));
+}
+
+static void print_W_sigs(FILE *f, const trace_stage_t *ts) {
+    fprintf(f, "\t W_sigs: [dst_31isSP, dst_sel, wval_sel, w_enable] = [%s, %s, %s, %s]\n",
+            TF_(ts, TS_DST_31ISSP), TF_(ts, TS_DST_SEL), TF_(ts, TS_WVAL_SEL),
+            TF(ts, TS_W_ENABLE));
+}
+
+/*
+ * Print the state of every pipeline register at the end of a cycle.
+ * Level 1 prints the data values; level 2 adds the bubble/stall flags and
+ * control signals.
+ */
+
+void trace_print(FILE *f, const trace_rec_t *tr, const int level) {
+    const trace_stage_t *ts;
+
+    fprintf(f, "\nPipeline state at end of cycle %" PRIu64 ":\n", tr->tr_cycle);
+
+    ts = &tr->tr_stage[0];
+    fprintf(f, "F: %-6s[PC, insn_bits] = [%08" PRIX64 ",  %08X], seq_succ_PC: 0x%" PRIX64
+            ", pred_PC: 0x%" PRIX64 "\n",
+            NAME(opcode_names, ts->ts_op), tr->tr_PC, ts->ts_insnbits,
+            ts->ts_seq_succ_PC, tr->tr_pred_PC);
+    if (level > 1)
+        print_bubble_stall(f, ts);
+
+    ts = &tr->tr_stage[1];
+    fprintf(f, "D: %-6s[val_a, val_b, imm] = [0x%" PRIX64 ", 0x%" PRIX64 ", 0x%" PRIX64
+            "], alu_op: %s, cond: %s, dst: X%d\n",
+            NAME(opcode_names, ts->ts_op), ts->ts_val_a, ts->ts_val_b, ts->ts_val_imm,
+            NAME(alu_op_names, ts->ts_ALU_op), NAME(cond_names, ts->ts_cond), ts->ts_dst);
+    if (level > 1) {
+        print_bubble_stall(f, ts);
+        print_X_sigs(f, ts);
+        print_M_sigs(f, ts);
+        print_W_sigs(f, ts);
+    }
+
+    ts = &tr->tr_stage[2];
+    fprintf(f, "X: %-6s[val_ex, a, b, imm, hw, cond, condval] = [0x%" PRIX64 ", 0x%" PRIX64
+            ", 0x%" PRIX64 ", 0x%" PRIX64 ", 0x%X, %s, %s], alu_op: %s\n",
+            NAME(opcode_names, ts->ts_op), ts->ts_val_ex, ts->ts_val_a, ts->ts_val_b,
+            ts->ts_val_imm, ts->ts_hw, NAME(cond_names, ts->ts_cond),
+            tr->tr_condval ? "true" : "false", NAME(alu_op_names, ts->ts_ALU_op));
+    if (level > 1) {
+        print_bubble_stall(f, ts);
+        print_X_sigs(f, ts);
+    }
+
+    ts = &tr->tr_stage[3];
+    fprintf(f, "M: %-6s[val_ex, val_b, val_mem] = [0x%" PRIX64 ", 0x%" PRIX64 ", 0x%" PRIX64 "]\n",
+            NAME(opcode_names, ts->ts_op), ts->ts_val_ex, ts->ts_val_b, ts->ts_val_mem);
+    if (level > 1) {
+        print_bubble_stall(f, ts);
+        print_M_sigs(f, ts);
+    }
+
+    ts = &tr->tr_stage[4];
+    fprintf(f, "W: %-6s[dst, val_ex, val_mem] = [X%d, 0x%" PRIX64 ", 0x%" PRIX64 "]\n",
+            NAME(opcode_names, ts->ts_op), ts->ts_dst, ts->ts_val_ex, ts->ts_val_mem);
+    if (level > 1) {
+        print_bubble_stall(f, ts);
+        print_W_sigs(f, ts);
+    }
+
+    fprintf(f, "\n\n");
+}
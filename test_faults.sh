@@ -0,0 +1,15 @@
+#!/bin/bash
+# Each program must die with the protection fault its source expects.
+SE="./se -i "
+TEST_1="testcases/faults/exec_data"
+TEST_2="testcases/faults/write_text"
+
+for TEST in $TEST_1 $TEST_2; do
+    echo "Running test" $TEST
+    EXPECTED=$(grep "expected:" $TEST.s | sed 's/.*expected: //')
+    if $SE $TEST < /dev/null 2>&1 | grep -q "$EXPECTED"; then
+        echo "PASS:" $EXPECTED
+    else
+        echo "FAIL: expected" $EXPECTED
+    fi
+done
@@ -0,0 +1,18 @@
+	.arch armv8-a
+	.text
+	.align	2
+	.globl	start
+start:
+
+    // EXECUTE FROM A DATA PAGE
+        // The data segment at 0x800000 is readable and writable, but not
+        // executable. Returning into it must raise a protection fault on
+        // the fetch, not run whatever the page holds.
+
+    // Point the return address at the data segment
+	movz	x30, #0x80, lsl #16
+
+    // expected: Protection fault on execute of address 0x800000
+	ret
+	.size	start, .-start
+	.section	.note.GNU-stack,"",@progbits
@@ -0,0 +1,28 @@
+	.arch armv8-a
+	.text
+	.align	2
+	.globl	start
+start:
+
+    // WRITE TO THE TEXT SEGMENT
+        // The text segment at 0x400000 is readable and executable, but
+        // not writable. A store to it must raise a protection fault
+        // before any byte of the code changes.
+
+    // Point x1 at the start of the text segment
+	movz	x1, #0x40, lsl #16
+	movz	x0, #429
+
+    // expected: Protection fault on write of address 0x400000
+	stur	x0, [x1]
+
+    // Not reached: print x0
+	eor 	x5, x5, x5
+	mvn 	x5, x5
+	stur	x0, [x5]
+    nop
+    nop
+    nop
+	ret
+	.size	start, .-start
+	.section	.note.GNU-stack,"",@progbits